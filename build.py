@@ -5,8 +5,8 @@ import os
 
 # Flags controlling build
 COMPILERS     = "mpic++ mpic++.openmpi mpicc mpicpc"
-COMPILE_FLAGS = "-c -Wall -g -O3 -std=c++11"
-LINK_FLAGS    = "-o xdmc"
+COMPILE_FLAGS = "-c -Wall -g -O3 -std=c++11 -fopenmp -pthread"
+LINK_FLAGS    = "-o xdmc -fopenmp -pthread"
 LIBS          = "-lstdc++ -lm"
 
 # Check if clean requested
@@ -21,7 +21,7 @@ if "clean" in sys.argv:
 
 # Check if this is a debug build
 if "debug" in sys.argv:
-    COMPILE_FLAGS = "-c -Wall -g"
+    COMPILE_FLAGS = "-c -Wall -g -fopenmp -pthread"
 
 # Find a compiler that works
 import subprocess
@@ -0,0 +1,217 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#include <mpi.h>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+
+#include "catch.h"
+#include "benchmark.h"
+#include "params.h"
+#include "walker_collection.h"
+#include "mpi_utils.h"
+#include "random.h"
+#include "dmc_math.h"
+#include "timers.h"
+#include "utils.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// The untimed iterations before each benchmark, and the timed
+// iterations, walkers per process and diffusion schemes benchmarked
+static const unsigned warmup_iterations    = 2;
+static const unsigned benchmark_iterations = 20;
+static const unsigned walker_counts[]      = {128, 256, 512, 1024};
+static const char*    diffusion_schemes[]  = {
+    "exact_1d", "bosonic", "exchange_diffuse", "max_seperation",
+    "max_seperation_mpi", "stochastic_nodes", "stochastic_nodes_mpi",
+    "stochastic_nodes_permutations"
+};
+
+benchmark_result run_benchmark_case(std::string input, unsigned iterations)
+{
+    // Set up the system, as if it were read from the input file
+    std::istringstream input_stream(input);
+    if (!params::read_input(input_stream))
+        throw "Could not set up benchmark system!";
+
+    walker_collection::select_kernels();
+    select_fexp();
+
+    // Every benchmark starts from the same random numbers
+#ifdef _OPENMP
+    omp_set_dynamic(0);
+    omp_set_num_threads(params::threads);
+#endif
+    #pragma omp parallel num_threads(params::threads)
+    seed_random(params::seed, params::pid*params::threads + thread_id());
+
+    // Propagate the walkers as run_dmc does (without output)
+    walker_collection* walkers      = new walker_collection();
+    walker_collection* walkers_next = new walker_collection(nullptr);
+
+    double start = 0;
+    double walker_steps = 0;
+    for (unsigned i=0; i<warmup_iterations+iterations; ++i)
+    {
+        if (i == warmup_iterations)
+        {
+            // Start timing, once all processes are ready
+            MPI_Barrier(MPI_COMM_WORLD);
+            walker_collection::psi_d_evaluations = 0;
+            start = wall_time();
+        }
+
+        params::dmc_iteration = i + 1;
+        if (i >= warmup_iterations) walker_steps += walkers->size();
+        if (walkers_next->propagate(walkers))
+        {
+            walker_collection* tmp = walkers;
+            walkers      = walkers_next;
+            walkers_next = tmp;
+        }
+        walkers->balance_load();
+        walkers->estimate_tau_nodes();
+    }
+
+    // The time taken by the slowest process
+    MPI_Barrier(MPI_COMM_WORLD);
+    benchmark_result result;
+    result.time = wall_time() - start;
+    result.walker_steps = mpi_sum(walker_steps);
+    result.psi_d_evaluations = mpi_sum(double(walker_collection::psi_d_evaluations));
+
+    delete walkers;
+    delete walkers_next;
+    return result;
+}
+
+// The input describing N fermions in a harmonic well, or a lithium-like
+// atom (a nucleus of charge 3 and three electrons), in d dimensions
+static std::string benchmark_system(std::string name, unsigned d)
+{
+    std::string origin = "";
+    for (unsigned i=0; i<d; ++i) origin += " 0";
+
+    std::string input = "dimensions " + std::to_string(d) + "\n";
+    if (name == "harmonic_well")
+    {
+        input += "harmonic_well 1.0\n";
+        for (unsigned i=0; i<3; ++i)
+            input += "particle f 1 0 1" + origin + "\n";
+    }
+    else
+    {
+        input += "atomic_potential 3" + origin + "\n";
+        input += "particle e 1 -1 1"  + origin + "\n";
+        input += "particle e 1 -1 1"  + origin + "\n";
+        input += "particle e 1 -1 -1" + origin + "\n";
+    }
+    return input;
+}
+
+void run_benchmark()
+{
+    // Use the threads OpenMP would by default (see OMP_NUM_THREADS),
+    // if MPI supports calls from multithreaded processes
+    unsigned threads = 1;
+#ifdef _OPENMP
+    if (params::mpi_thread_support >= MPI_THREAD_FUNNELED)
+        threads = omp_get_max_threads();
+#endif
+
+    if (params::pid == 0)
+        std::cout << "System,Dimensions,Particles,Diffusion scheme,Processes,Threads,"
+                  << "Walkers,Iterations,Time,Walker steps per second,"
+                  << "Psi_D evaluations per second,Scaling exponent\n";
+
+    for (std::string system : {"harmonic_well", "lithium"})
+        for (unsigned d=1; d<=3; ++d)
+            for (const char* scheme : diffusion_schemes)
+            {
+                if (std::string(scheme) == "exact_1d" && d != 1) continue;
+
+                // Scaling of the time per iteration with the number of
+                // walkers, relative to the previous number of walkers
+                double last_time    = 0;
+                double last_walkers = 0;
+                for (unsigned w : walker_counts)
+                {
+                    unsigned walkers = w * params::np;
+                    std::string input = benchmark_system(system, d);
+                    input += "walkers "           + std::to_string(walkers) + "\n";
+                    input += "threads "           + std::to_string(threads) + "\n";
+                    input += "diffusion_scheme "  + std::string(scheme) + "\n";
+                    input += "tau 0.01\n"
+                             "tau_nodes 0.1\n"
+                             "coulomb_softening 0.1\n"
+                             "trial_energy 0\n";
+
+                    benchmark_result r = run_benchmark_case(input, benchmark_iterations);
+                    if (params::pid != 0) continue;
+
+                    char row[512];
+                    snprintf(row, sizeof(row), "%s,%u,%u,%s,%d,%u,%u,%u,%.6g,%.6g,%.6g,",
+                             system.c_str(), d, walker::particle_count(), scheme, params::np,
+                             threads, walkers, benchmark_iterations, r.time,
+                             r.walker_steps / r.time, r.psi_d_evaluations / r.time);
+                    std::cout << row;
+                    if (last_walkers > 0)
+                        std::cout << log(r.time / last_time) / log(walkers / last_walkers);
+                    std::cout << std::endl;
+
+                    last_time    = r.time;
+                    last_walkers = walkers;
+                }
+            }
+}
+
+TEST_CASE("Benchmark tests", "[benchmark]")
+{
+    // Run a small benchmark, restoring the parameters it sets
+    unsigned dimensions = params::dimensions;
+    unsigned population = params::target_population;
+    std::string scheme  = params::diffusion_scheme;
+    double trial_energy = params::trial_energy;
+
+    std::string input = "dimensions 1\n"
+                        "walkers 32\n"
+                        "diffusion_scheme stochastic_nodes\n"
+                        "harmonic_well 1.0\n"
+                        "particle f 1 0 1 0\n"
+                        "particle f 1 0 1 0\n";
+    benchmark_result r = run_benchmark_case(input, 3);
+
+    std::istringstream empty("");
+    params::read_input(empty);
+    params::dimensions        = dimensions;
+    params::target_population = population;
+    params::diffusion_scheme  = scheme;
+    params::trial_energy      = trial_energy;
+    params::dmc_iteration     = 0;
+    walker_collection::select_kernels();
+
+    // Every walker evaluates psi_D before and after diffusion
+    REQUIRE(r.time > 0);
+    REQUIRE(r.walker_steps > 0);
+    REQUIRE(r.psi_d_evaluations == 2*r.walker_steps);
+}
@@ -0,0 +1,44 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#ifndef __BENCHMARK__
+#define __BENCHMARK__
+
+#include <string>
+
+// The result of propagating walkers for a number of
+// iterations (totals over all processes)
+struct benchmark_result
+{
+    double time;
+    double walker_steps;
+    double psi_d_evaluations;
+};
+
+// Set up the system described by input (in the format of the input
+// file) and time iterations of it's propagation, after a couple of
+// untimed iterations to warm up. Called on all processes together.
+benchmark_result run_benchmark_case(std::string input, unsigned iterations);
+
+// Benchmark each diffusion scheme on synthetic systems (fermions in
+// a harmonic well and lithium-like atoms, in 1, 2 and 3 dimensions)
+// at increasing numbers of walkers, writing the results to stdout
+// as CSV. No input file is needed.
+void run_benchmark();
+
+#endif
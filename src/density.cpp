@@ -0,0 +1,270 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#include <cmath>
+#include <algorithm>
+#include <mpi.h>
+
+#include "catch.h"
+#include "density.h"
+#include "particle.h"
+#include "params.h"
+#include "mpi_profile.h"
+
+density_accumulator :: density_accumulator(unsigned bins, double range, bool pairs)
+{
+    this->bins  = bins;
+    this->range = range;
+    this->pairs = pairs;
+    this->dims  = params::dimensions;
+    this->cells = 1;
+    for (unsigned d=0; d<dims; ++d)
+        this->cells *= bins;
+
+    // Particles belong to the same species if they are identical
+    unsigned n = params::template_system.size();
+    for (unsigned i=0; i<n; ++i)
+    {
+        particle* p = params::template_system[i];
+        unsigned s  = 0;
+        while (s < species_particles.size())
+        {
+            particle* q = params::template_system[species_particles[s][0]];
+            if (p->name == q->name && p->exchange_symmetry(q) != 0) break;
+            ++s;
+        }
+        if (s == species_particles.size()) species_particles.emplace_back();
+        species_particles[s].push_back(i);
+        species.push_back(s);
+    }
+
+    unsigned histograms = species_count();
+    if (pairs) histograms += species_count()*(species_count()+1)/2;
+    counts.assign(histograms*cells + 1, 0.0);
+}
+
+double* density_accumulator :: pair_density(unsigned s, unsigned t)
+{
+    // The pair densities for species s <= t
+    // follow the densities, in the order
+    // (0,0), (0,1) ... (0,S-1), (1,1) ...
+    unsigned S = species_count();
+    unsigned p = s*S - s*(s-1)/2 + (t - s);
+    return &counts[(S + p)*cells];
+}
+
+int density_accumulator :: cell(double* x)
+{
+    // Returns the grid cell containing the
+    // point x, or -1 if it is outside the grid
+    int c = 0;
+    for (unsigned d=0; d<dims; ++d)
+    {
+        int b = int(floor(bins*(x[d] + range)/(2*range)));
+        if (b < 0 || b >= int(bins)) return -1;
+        c = c*bins + b;
+    }
+    return c;
+}
+
+void density_accumulator :: accumulate(double* coords, double* weights, unsigned count)
+{
+    // Bin the particles in each walker, weighted by the magnitude
+    // of the walker weight (signed weights would cancel between
+    // the positive and negative regions of a fermionic wavefunction)
+    unsigned n  = species.size();
+    unsigned cc = n * dims;
+    static thread_local std::vector<double> sep;
+    sep.resize(dims);
+    for (unsigned w=0; w<count; ++w)
+    {
+        double* x = coords + w*cc;
+        double weight = fabs(weights[w]);
+        counts.back() += weight;
+
+        for (unsigned i=0; i<n; ++i)
+        {
+            int c = cell(x + i*dims);
+            if (c >= 0) density(species[i])[c] += weight;
+        }
+
+        if (!pairs) continue;
+        for (unsigned i=0; i<n; ++i)
+            for (unsigned j=0; j<n; ++j)
+            {
+                // Both orderings are counted within
+                // a species, otherwise s <= t
+                if (i == j || species[i] > species[j]) continue;
+                for (unsigned d=0; d<dims; ++d)
+                    sep[d] = x[j*dims+d] - x[i*dims+d];
+                int c = cell(sep.data());
+                if (c >= 0) pair_density(species[i], species[j])[c] += weight;
+            }
+    }
+}
+
+void density_accumulator :: write_histogram(std::string filename, std::string description,
+                                            double* histogram, double norm)
+{
+    // Write a histogram, normalized by norm, as a
+    // header followed by one value per line (with
+    // the cells in the order [x][y][z])
+    output_file file(filename);
+    file << "# " << description << "\n";
+    file << "# dimensions " << dims  << "\n";
+    file << "# bins "       << bins  << "\n";
+    file << "# range "      << range << "\n";
+    for (unsigned c=0; c<cells; ++c)
+        file << histogram[c] * norm << "\n";
+}
+
+void density_accumulator :: write()
+{
+    mpi_call_site site("density_accumulator::write");
+
+    // Sum the histograms (and total weight) across processes
+    if (params::pid == 0)
+        MPI_Reduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    else
+        MPI_Reduce(counts.data(), nullptr, counts.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (params::pid != 0) return;
+
+    // Normalize to particles per unit volume, such that
+    // a density integrates to the number of particles of
+    // that species within the grid (the histograms are
+    // written as zero if nothing has been accumulated)
+    double cell_volume = pow(2*range/bins, dims);
+    double norm = 0.0;
+    if (total_weight() > 0) norm = 1.0 / (total_weight() * cell_volume);
+
+    auto particle_list = [this](unsigned s)
+    {
+        std::string list = params::template_system[species_particles[s][0]]->name + " (particles";
+        for (unsigned i : species_particles[s]) list += " " + std::to_string(i);
+        return list + ")";
+    };
+
+    for (unsigned s=0; s<species_count(); ++s)
+    {
+        std::string desc = "Density of " + particle_list(s);
+        write_histogram("density_" + std::to_string(s), desc, density(s), norm);
+    }
+
+    if (!pairs) return;
+    for (unsigned s=0; s<species_count(); ++s)
+        for (unsigned t=s; t<species_count(); ++t)
+        {
+            std::string desc = "Pair density of the seperation of " + particle_list(t) +
+                               " from " + particle_list(s);
+            std::string filename = "pair_density_" + std::to_string(s) + "_" + std::to_string(t);
+            write_histogram(filename, desc, pair_density(s, t), norm);
+        }
+}
+
+void density_accumulator :: save_state(std::vector<double>& state)
+{
+    mpi_call_site site("density_accumulator::save_state");
+
+    // Stored as the number of values, followed by the values
+    std::vector<double> sum(counts.size());
+    MPI_Reduce(counts.data(), sum.data(), counts.size(), MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (params::pid != 0) return;
+    state.push_back(sum.size());
+    state.insert(state.end(), sum.begin(), sum.end());
+}
+
+void density_accumulator :: load_state(const std::vector<double>& state, unsigned& position)
+{
+    // The sum is restored on the root process (the
+    // others carry on from zero). Histograms of a
+    // different grid are discarded.
+    std::fill(counts.begin(), counts.end(), 0.0);
+    if (position >= state.size()) return;
+    unsigned count = state[position++];
+    if (position + count > state.size())
+        throw "Density state is incomplete!";
+
+    if (params::pid == 0 && count == counts.size())
+        std::copy(state.begin() + position, state.begin() + position + count, counts.begin());
+    position += count;
+}
+
+TEST_CASE("Density accumulation tests", "[density]")
+{
+    // Two identical particles and one other
+    // (in a temporary system)
+    for (unsigned i=0; i<3; ++i)
+    {
+        particle* p   = new particle();
+        p->name       = i < 2 ? "e" : "p";
+        p->mass       = i < 2 ? 1.0 : 1836.0;
+        p->charge     = i < 2 ? -1.0 : 1.0;
+        p->half_spins = 1;
+        params::template_system.push_back(p);
+    }
+
+    density_accumulator densities(4, 1.0, true);
+    REQUIRE(densities.species_count() == 2);
+    REQUIRE(densities.cell_count() == pow(4, params::dimensions));
+
+    // One walker, with the third particle off the grid
+    unsigned d = params::dimensions;
+    std::vector<double> x(3*d, 0.1);
+    x[d]   = -0.6;
+    x[2*d] = 5.0;
+    double weight = 2.0;
+    densities.accumulate(&x[0], &weight, 1);
+
+    auto sum = [&densities](double* h)
+    {
+        double s = 0;
+        for (unsigned c=0; c<densities.cell_count(); ++c) s += h[c];
+        return s;
+    };
+
+    REQUIRE(densities.total_weight() == 2.0);
+    REQUIRE(sum(densities.density(0)) == 4.0);
+    REQUIRE(sum(densities.density(1)) == 0.0);
+
+    // Both orderings of the identical pair are counted
+    REQUIRE(sum(densities.pair_density(0, 0)) == 4.0);
+    REQUIRE(sum(densities.pair_density(0, 1)) == 0.0);
+    REQUIRE(sum(densities.pair_density(1, 1)) == 0.0);
+
+    // Walkers of opposite sign add to, rather than
+    // cancel, the densities (the particles of a second
+    // walker, of weight -2, all on the grid at 0.1)
+    std::fill(x.begin(), x.end(), 0.1);
+    weight = -2.0;
+    densities.accumulate(&x[0], &weight, 1);
+
+    REQUIRE(densities.total_weight() == 4.0);
+    REQUIRE(sum(densities.density(0)) == 8.0);
+    REQUIRE(sum(densities.density(1)) == 2.0);
+    REQUIRE(sum(densities.pair_density(0, 0)) == 8.0);
+    REQUIRE(sum(densities.pair_density(0, 1)) == 4.0);
+    REQUIRE(sum(densities.pair_density(1, 1)) == 0.0);
+
+    // Normalized, each density integrates to the average number
+    // of particles of that species within the grid
+    REQUIRE(sum(densities.density(0)) / densities.total_weight() == 2.0);
+    REQUIRE(sum(densities.density(1)) / densities.total_weight() == 0.5);
+
+    for (particle* p : params::template_system) delete p;
+    params::template_system.clear();
+}
@@ -0,0 +1,83 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#ifndef __DENSITY__
+#define __DENSITY__
+
+#include <vector>
+#include <string>
+
+// Accumulates histograms of particle positions, weighted by the
+// magnitude of the walker weights, on a regular grid of
+// bins^dimensions cells covering [-range, range] in each dimension,
+// directly from walker configurations stored as
+// [walker][particle][dimension]. A density is accumulated for each
+// species of identical particles and, optionally, a pair density
+// (of the seperations x_j - x_i) for each pair of species. Each
+// process accumulates it's own walkers; the histograms are summed
+// across processes by a single reduction in write(). The densities
+// written are those of the walker distribution, i.e of |psi|
+// integrated over the other particles, rather than |psi|^2.
+class density_accumulator
+{
+public:
+    density_accumulator(unsigned bins, double range, bool pairs);
+
+    // Add count walkers, with the given weights and configurations
+    void accumulate(double* coords, double* weights, unsigned count);
+
+    // Sum the histograms across processes and write the normalized
+    // densities to files on the root process
+    void write();
+
+    // Append the histograms, summed across processes, to state on the
+    // root process (collective), or restore them from the state on the
+    // root process (starting at, and advancing, position)
+    void save_state(std::vector<double>& state);
+    void load_state(const std::vector<double>& state, unsigned& position);
+
+    unsigned species_count() { return species_particles.size(); }
+    unsigned cell_count()    { return cells; }
+
+    // The accumulated (unnormalized) histogram for species s,
+    // and for seperations of species t from species s (s <= t)
+    double* density(unsigned s)               { return &counts[s*cells]; }
+    double* pair_density(unsigned s, unsigned t);
+    double  total_weight()                    { return counts.back(); }
+
+private:
+    int cell(double* x);
+    void write_histogram(std::string filename, std::string description,
+                         double* histogram, double norm);
+
+    unsigned bins;
+    double   range;
+    bool     pairs;
+    unsigned dims;
+    unsigned cells;
+
+    // The species of each particle, and the particles of each species
+    std::vector<unsigned> species;
+    std::vector<std::vector<unsigned>> species_particles;
+
+    // The histograms, stored as [species densities][pair densities]
+    // followed by the total |weight| accumulated
+    std::vector<double> counts;
+};
+
+#endif
@@ -17,7 +17,17 @@
 
 */
 
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define X86_KERNELS
+#endif
+
 #include "catch.h"
+#include "random.h"
 #include "dmc_math.h"
 #include "params.h"
 
@@ -42,6 +52,216 @@ unsigned factorial(unsigned n)
     return n * factorial(n-1);
 }
 
+double determinant(double* a, unsigned n)
+{
+    // Returns the determinant of the n x n matrix a (stored
+    // row-major) by LU decomposition with partial pivoting
+    // in O(n^3). The matrix a is overwritten.
+    double det = 1;
+    for (unsigned k=0; k<n; ++k)
+    {
+        // Find the pivot
+        unsigned piv = k;
+        for (unsigned i=k+1; i<n; ++i)
+            if (fabs(a[i*n+k]) > fabs(a[piv*n+k]))
+                piv = i;
+        if (a[piv*n+k] == 0) return 0;
+
+        if (piv != k)
+        {
+            for (unsigned j=0; j<n; ++j)
+                std::swap(a[k*n+j], a[piv*n+j]);
+            det = -det;
+        }
+
+        det *= a[k*n+k];
+        for (unsigned i=k+1; i<n; ++i)
+        {
+            double f = a[i*n+k]/a[k*n+k];
+            for (unsigned j=k+1; j<n; ++j)
+                a[i*n+j] -= f * a[k*n+j];
+        }
+    }
+    return det;
+}
+
+double permanent(double* a, unsigned n)
+{
+    // Returns the permanent of the n x n matrix a (stored row-major)
+    // using Ryser's formula in O(2^n n), visiting the column subsets
+    // S in gray code order so that each step adds/removes one column
+    //   perm(a) = (-1)^n sum_S (-1)^|S| prod_i sum_{j in S} a_ij
+    std::vector<double> row_sums(n, 0);
+    double perm  = 0;
+    int    s     = 1;
+    for (unsigned long k=1; k < (1ul << n); ++k)
+    {
+        // Flip the column given by the lowest set bit of k
+        unsigned j = 0;
+        while (((k >> j) & 1) == 0) ++j;
+        bool add = ((k ^ (k >> 1)) >> j) & 1;
+        for (unsigned i=0; i<n; ++i)
+            row_sums[i] += add ? a[i*n+j] : -a[i*n+j];
+        s = -s;
+
+        double prod = s;
+        for (unsigned i=0; i<n; ++i)
+            prod *= row_sums[i];
+        perm += prod;
+    }
+    return n % 2 == 0 ? perm : -perm;
+}
+
+// Constants for the fast exponential. exp(x) is evaluated as
+// 2^k exp(r), where k = round(x/ln 2), r = x - k ln 2 (so |r| <= ln(2)/2)
+// and exp(r) is given by it's taylor series up to r^11 (relative
+// error < 1e-14). Results smaller than DBL_MIN are flushed to zero.
+const double exp_max     = 709.0;
+const double exp_min     = -708.0;
+const double exp_log2e   = 1.44269504088896338700;
+const double exp_ln2_hi  = 6.93147180369123816490e-01;
+const double exp_ln2_lo  = 1.90821492927058770002e-10;
+const double exp_round   = 6755399441055744.0; // 1.5 * 2^52
+const unsigned exp_order = 11;
+const double exp_taylor[exp_order+1] = {
+    1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040,
+    1.0/40320, 1.0/362880, 1.0/3628800, 1.0/39916800 };
+
+void fexp_exact(double* x, unsigned n)
+{
+    // Exact (libm) exponentials
+    for (unsigned i=0; i<n; ++i)
+        x[i] = exp(x[i]);
+}
+
+void fexp_fast_scalar(double* x, unsigned n)
+{
+    // Fast exponentials, portable version
+    for (unsigned i=0; i<n; ++i)
+    {
+        double xi = x[i];
+        bool zero = xi < exp_min;
+        xi = std::min(std::max(xi, exp_min), exp_max);
+
+        // k = round(x/ln 2) (in the low bits of kr)
+        double kr = xi * exp_log2e + exp_round;
+        double k  = kr - exp_round;
+        double r  = (xi - k*exp_ln2_hi) - k*exp_ln2_lo;
+
+        double p = exp_taylor[exp_order];
+        for (int j=exp_order-1; j>=0; --j)
+            p = p*r + exp_taylor[j];
+
+        // Build 2^k from the bits of kr
+        int64_t bits;
+        memcpy(&bits, &kr, sizeof(bits));
+        bits = (bits + 1023) << 52;
+        double two_k;
+        memcpy(&two_k, &bits, sizeof(two_k));
+
+        x[i] = zero ? 0.0 : p * two_k;
+    }
+}
+
+#ifdef X86_KERNELS
+__attribute__((target("avx2,fma")))
+void fexp_fast_avx2(double* x, unsigned n)
+{
+    // Fast exponentials, four at a time using AVX2
+    const __m256d max   = _mm256_set1_pd(exp_max);
+    const __m256d min   = _mm256_set1_pd(exp_min);
+    const __m256d log2e = _mm256_set1_pd(exp_log2e);
+    const __m256d ln2hi = _mm256_set1_pd(exp_ln2_hi);
+    const __m256d ln2lo = _mm256_set1_pd(exp_ln2_lo);
+    const __m256d round = _mm256_set1_pd(exp_round);
+    const __m256i bias  = _mm256_set1_epi64x(1023);
+
+    unsigned i = 0;
+    for (; i+4 <= n; i+=4)
+    {
+        __m256d xi   = _mm256_loadu_pd(x+i);
+        __m256d zero = _mm256_cmp_pd(xi, min, _CMP_LT_OQ);
+        xi = _mm256_min_pd(_mm256_max_pd(xi, min), max);
+
+        __m256d kr = _mm256_fmadd_pd(xi, log2e, round);
+        __m256d k  = _mm256_sub_pd(kr, round);
+        __m256d r  = _mm256_fnmadd_pd(k, ln2hi, xi);
+        r = _mm256_fnmadd_pd(k, ln2lo, r);
+
+        __m256d p = _mm256_set1_pd(exp_taylor[exp_order]);
+        for (int j=exp_order-1; j>=0; --j)
+            p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(exp_taylor[j]));
+
+        __m256i bits = _mm256_add_epi64(_mm256_castpd_si256(kr), bias);
+        __m256d two_k = _mm256_castsi256_pd(_mm256_slli_epi64(bits, 52));
+        p = _mm256_mul_pd(p, two_k);
+        _mm256_storeu_pd(x+i, _mm256_andnot_pd(zero, p));
+    }
+    fexp_fast_scalar(x+i, n-i);
+}
+
+// GCC's avx512fintrin.h gives false -Wmaybe-uninitialized warnings
+// (the undefined pass-through operand of its unmasked intrinsics)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+__attribute__((target("avx512f")))
+void fexp_fast_avx512(double* x, unsigned n)
+{
+    // Fast exponentials, eight at a time using AVX-512
+    const __m512d max   = _mm512_set1_pd(exp_max);
+    const __m512d min   = _mm512_set1_pd(exp_min);
+    const __m512d log2e = _mm512_set1_pd(exp_log2e);
+    const __m512d ln2hi = _mm512_set1_pd(exp_ln2_hi);
+    const __m512d ln2lo = _mm512_set1_pd(exp_ln2_lo);
+    const __m512d round = _mm512_set1_pd(exp_round);
+    const __m512i bias  = _mm512_set1_epi64(1023);
+
+    unsigned i = 0;
+    for (; i+8 <= n; i+=8)
+    {
+        __m512d xi    = _mm512_loadu_pd(x+i);
+        __mmask8 keep = _mm512_cmp_pd_mask(xi, min, _CMP_GE_OQ);
+        xi = _mm512_min_pd(_mm512_max_pd(xi, min), max);
+
+        __m512d kr = _mm512_fmadd_pd(xi, log2e, round);
+        __m512d k  = _mm512_sub_pd(kr, round);
+        __m512d r  = _mm512_fnmadd_pd(k, ln2hi, xi);
+        r = _mm512_fnmadd_pd(k, ln2lo, r);
+
+        __m512d p = _mm512_set1_pd(exp_taylor[exp_order]);
+        for (int j=exp_order-1; j>=0; --j)
+            p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(exp_taylor[j]));
+
+        __m512i bits = _mm512_add_epi64(_mm512_castpd_si512(kr), bias);
+        __m512d two_k = _mm512_castsi512_pd(_mm512_slli_epi64(bits, 52));
+        p = _mm512_mul_pd(p, two_k);
+        _mm512_storeu_pd(x+i, _mm512_maskz_mov_pd(keep, p));
+    }
+    fexp_fast_scalar(x+i, n-i);
+}
+#pragma GCC diagnostic pop
+#endif
+
+// The selected exponential (exact until select_fexp is called)
+void (*fexp_array)(double* x, unsigned n) = fexp_exact;
+
+void select_fexp()
+{
+    // Select the exponential set by params::exp_method,
+    // using the widest vector instructions available
+    fexp_array = fexp_exact;
+    if (params::exp_method != "fast") return;
+
+    fexp_array = fexp_fast_scalar;
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        fexp_array = fexp_fast_avx512;
+    else if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        fexp_array = fexp_fast_avx2;
+#endif
+}
+
 TEST_CASE("Basic math functions", "[math]")
 {
     // Test the coulomb interaction
@@ -62,5 +282,126 @@ TEST_CASE("Basic math functions", "[math]")
     REQUIRE(factorial(1) == 1  );
     REQUIRE(factorial(2) == 2  );
     REQUIRE(factorial(5) == 120);
+
+    // Test the permutations, which should be
+    // distinct, in lexicographic order and
+    // have signs matching the parity of the
+    // number of swaps needed to sort them
+    std::vector<unsigned> elems = {0, 1, 2, 3};
+    permutations<unsigned> perms(elems);
+    REQUIRE(perms.size() == 24);
+    unsigned last[4] = {0, 0, 0, 0};
+    for (unsigned m=0; m<perms.size(); ++m)
+    {
+        unsigned p[4];
+        double sign = perms.unrank(m, p);
+        REQUIRE(sign == perms.sign(m));
+        if (m > 0) REQUIRE(std::lexicographical_compare(last, last+4, p, p+4));
+        for (unsigned i=0; i<4; ++i) last[i] = p[i];
+
+        double swap_sign = 1;
+        for (unsigned i=0; i<4; ++i)
+            while (p[i] != i)
+            {
+                std::swap(p[i], p[p[i]]);
+                swap_sign = -swap_sign;
+            }
+        REQUIRE(sign == swap_sign);
+    }
+
+    // Permutations of large groups can be unranked or sampled
+    std::vector<unsigned> big(20);
+    for (unsigned i=0; i<20; ++i) big[i] = i;
+    permutations<unsigned> big_perms(big);
+    unsigned p[20];
+    REQUIRE(big_perms.unrank(big_perms.size()-1, p) == 1.0);
+    REQUIRE(p[0] == 19);
+    big_perms.sample(p);
+    std::sort(p, p+20);
+    for (unsigned i=0; i<20; ++i)
+        REQUIRE(p[i] == i);
+
+    // Beyond that they can only be sampled
+    std::vector<unsigned> too_big(21);
+    permutations<unsigned> too_big_perms(too_big);
+    REQUIRE_THROWS(too_big_perms.size());
+    REQUIRE_THROWS(too_big_perms.unrank(0, p));
+
+    // There is one (empty) permutation of no elements
+    permutations<unsigned> no_perms(std::vector<unsigned>{});
+    REQUIRE(no_perms.size() == 1);
+    REQUIRE(no_perms.sample(p) == 1.0);
+}
+
+
+TEST_CASE("Determinant and permanent", "[math]")
+{
+    // Compare to explicit sums over permutations
+    for (unsigned n=1; n<=6; ++n)
+    {
+        std::vector<double> a(n*n);
+        for (unsigned i=0; i<n*n; ++i)
+            a[i] = rand_uniform() - 0.2;
+
+        std::vector<unsigned> rows(n);
+        for (unsigned i=0; i<n; ++i) rows[i] = i;
+        permutations<unsigned> perms(rows);
+
+        double det  = 0;
+        double perm = 0;
+        unsigned p[n];
+        for (unsigned m=0; m<perms.size(); ++m)
+        {
+            double sign = perms.unrank(m, p);
+            double prod = 1;
+            for (unsigned i=0; i<n; ++i)
+                prod *= a[i*n + p[i]];
+            det  += sign * prod;
+            perm += prod;
+        }
+
+        REQUIRE(fabs(permanent(&a[0], n) - perm) < 1e-12);
+        REQUIRE(fabs(determinant(&a[0], n) - det) < 1e-12);
+    }
 }
 
+TEST_CASE("Fast exponential", "[math]")
+{
+    // Check the relative error of each of the
+    // available fast exponentials
+    std::vector<void(*)(double*, unsigned)> kernels;
+    kernels.push_back(fexp_fast_scalar);
+#ifdef X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        kernels.push_back(fexp_fast_avx2);
+    if (__builtin_cpu_supports("avx512f"))
+        kernels.push_back(fexp_fast_avx512);
+#endif
+
+    const unsigned n = 10001;
+    for (auto kernel : kernels)
+    {
+        std::vector<double> x(n);
+        for (unsigned i=0; i<n; ++i)
+            x[i] = -700.0 + 1400.0*i/(n-1);
+        std::vector<double> y(x);
+        kernel(&y[0], n);
+
+        double max_error = 0;
+        for (unsigned i=0; i<n; ++i)
+            max_error = std::max(max_error, fabs(y[i] - exp(x[i]))/exp(x[i]));
+        REQUIRE(max_error < 1e-13);
+
+        // Underflow is flushed to zero
+        double tiny[9] = {-710, -800, -1e10, -710, -710, -710, -710, -710, -710};
+        kernel(tiny, 9);
+        for (unsigned i=0; i<9; ++i)
+            REQUIRE(tiny[i] == 0.0);
+    }
+
+    // The exact exponential should be the default
+    double x = 0.123;
+    fexp(&x, 1);
+    REQUIRE(x == exp(0.123));
+}
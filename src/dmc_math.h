@@ -22,6 +22,7 @@
 
 #include <math.h>
 #include <vector>
+#include "random.h"
 
 inline double fexp(double x)
 {
@@ -30,95 +31,142 @@ inline double fexp(double x)
     return exp(x);
 }
 
+// Replace x[i] with exp(x[i]) for i < n, using the method set by
+// params::exp_method (see select_fexp). Used for the exponentials
+// in the inner loops of the diffused wavefunction.
+extern void (*fexp_array)(double* x, unsigned n);
+inline void fexp(double* x, unsigned n) { fexp_array(x, n); }
+void select_fexp();
+
 int sign(double val);
 double coulomb(double q1, double q2, double r);
 unsigned factorial(unsigned n);
+double determinant(double* a, unsigned n);
+double permanent(double* a, unsigned n);
+
+template<unsigned D>
+inline double sq_norm(double* x, unsigned d)
+{
+    // Returns |x|^2 for a vector x with D components, specialised
+    // at compile time on D (D = 0 => d components, known at runtime)
+    if (D > 0) d = D;
+    double r2 = 0;
+    for (unsigned i=0; i<d; ++i)
+        r2 += x[i]*x[i];
+    return r2;
+}
+
+template<unsigned D>
+inline double sq_distance(double* x, double* y, unsigned d)
+{
+    // Returns |x - y|^2 for vectors x and y with D components, specialised
+    // at compile time on D (D = 0 => d components, known at runtime)
+    if (D > 0) d = D;
+    double r2 = 0;
+    for (unsigned i=0; i<d; ++i)
+    {
+        double dxi = x[i] - y[i];
+        r2 += dxi * dxi;
+    }
+    return r2;
+}
 
 template <class T>
 class permutations
 {
-    // This object constructs the permutations
-    // of the input vector v
+    // This object represents the permutations of
+    // the input vector a, without storing them. The
+    // i^th permutation (in lexicographic order) and
+    // it's sign are constructed on demand from the
+    // Lehmer code of i.
     public:
+        // The most elements for which the permutations can be
+        // counted/unranked (21! overflows a 64 bit integer)
+        static const unsigned max_elements = 20;
+
         permutations(std::vector<T> a)
         {
-            // Use heaps algorithm to
-            // generate permutations/signs
-            n     = a.size();
-            nfact = factorial(n);
-            row_number = 0;
-            s     = new double[nfact];
-            p     = new T*[nfact];
-            for (unsigned i=0; i<nfact; ++i)
-                p[i] = new T[n];
-
-            double sign = 1;
-            unsigned c[n];
-            for(unsigned i=0; i<n; ++i)
-                c[i] = 0;
-
-            output(a, sign);
-
-            unsigned i = 0;
-            while(i < n)
+            elems = a;
+            nfact = 1;
+            for (unsigned i=2; i<=a.size() && i<=max_elements; ++i)
+                nfact *= i;
+        }
+
+        // The number of permutations
+        unsigned long size()  { check_countable(); return nfact; }
+        unsigned elements()   { return elems.size(); }
+
+        double unrank(unsigned long i, T* p)
+        {
+            // Set p to the i^th permutation, returning it's sign. The
+            // Lehmer code digit c_j = the number of the remaining
+            // elements that precede p[j], so sum_j c_j = the number
+            // of inversions of the permutation.
+            check_countable();
+            unsigned n = elements();
+            std::vector<T> remaining(elems);
+            unsigned long place = nfact;
+            unsigned inversions = 0;
+            for (unsigned j=0; j<n; ++j)
             {
-                if (c[i] < i)
-                {
-                    sign  = -sign;
-                    T tmp = a[i];
-
-                    if (i % 2 == 0)
-                    {
-                        // i even => swap a[0], a[i]
-                        a[i] = a[0];
-                        a[0] = tmp;
-                    }
-                    else
-                    {
-                        // i odd => swap a[c[i]], a[i]
-                        a[i] = a[c[i]];
-                        a[c[i]] = tmp;
-                    }
-                    output(a, sign);
-                    ++c[i];
-                    i = 0;
-                }
-                else
-                {
-                    c[i] = 0;
-                    ++i;
-                }
+                place /= (n - j);
+                unsigned c = i / place;
+                i %= place;
+                p[j] = remaining[c];
+                remaining.erase(remaining.begin() + c);
+                inversions += c;
             }
+            return inversions % 2 == 0 ? 1.0 : -1.0;
         }
 
-        ~permutations()
+        double sign(unsigned long i)
         {
-            // Dealocate memory
-            delete[] s;
-            for (unsigned i=0; i<nfact; ++i)
-                delete[] p[i];
-            delete[] p;
+            // Return the sign of the i^th permutation, which
+            // only requires the Lehmer code digits of i
+            check_countable();
+            unsigned n = elements();
+            unsigned long place = nfact;
+            unsigned inversions = 0;
+            for (unsigned j=0; j<n; ++j)
+            {
+                place /= (n - j);
+                inversions += i / place;
+                i %= place;
+            }
+            return inversions % 2 == 0 ? 1.0 : -1.0;
         }
 
-        T* operator[](unsigned i) { return p[i];  }
-        unsigned size()           { return nfact; }
-        unsigned elements()       { return n;     }
-        double sign(unsigned i)   { return s[i];  }
+        double sample(T* p)
+        {
+            // Set p to a uniformly random permutation (by
+            // Fisher-Yates shuffle), returning it's sign
+            // (possible for any number of elements)
+            unsigned n = elements();
+            double s   = 1.0;
+            if (n == 0) return s;
+            for (unsigned j=0; j<n; ++j)
+                p[j] = elems[j];
+            for (unsigned j=n-1; j>0; --j)
+            {
+                unsigned k = rand_int(j+1);
+                if (k == j) continue;
+                T tmp = p[j];
+                p[j]  = p[k];
+                p[k]  = tmp;
+                s     = -s;
+            }
+            return s;
+        }
 
     private:
-        T** p;
-        double*  s;
-        unsigned nfact;
-        unsigned n;
-        unsigned row_number;
-
-        void output(std::vector<T> a, double sign)
+        void check_countable()
         {
-            s[row_number] = sign;
-            for (unsigned i=0; i<n; ++i)
-                p[row_number][i] = a[i];
-            ++ row_number;
+            if (elements() > max_elements)
+                throw "Too many elements to count/unrank their permutations!";
         }
+
+        std::vector<T> elems;
+        unsigned long nfact;
 };
 
 #endif
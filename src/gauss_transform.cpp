@@ -0,0 +1,361 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <cmath>
+#include <algorithm>
+
+#include "catch.h"
+#include "random.h"
+#include "gauss_transform.h"
+
+// The largest expansion we are willing to consider
+const unsigned max_terms = 1 << 16;
+
+// The most clusters we are willing to consider (clustering
+// costs O(points * clusters), and beyond this the cost of
+// evaluating the expansions rivals direct summation anyway)
+const unsigned max_cluster_count = 256;
+
+void gauss_transform :: monomials(double* v, double* m, unsigned* heads)
+{
+    // Evaluate all of the monomials v^a with |a| < order
+    // in graded order (the same order as the coefficients),
+    // heads is workspace of size dims
+    m[0] = 1;
+    for (unsigned i=0; i<dims; ++i) heads[i] = 0;
+    unsigned t    = 1;
+    unsigned tail = 1;
+    for (unsigned deg=1; deg<order; ++deg)
+    {
+        for (unsigned i=0; i<dims; ++i)
+        {
+            unsigned head = heads[i];
+            heads[i] = t;
+            for (unsigned j=head; j<tail; ++j)
+                m[t++] = v[i] * m[j];
+        }
+        tail = t;
+    }
+}
+
+void gauss_transform :: build(double* points, double* weights, unsigned count,
+                              unsigned dims, double h2, double tolerance)
+{
+    // Build the transform of the given points/weights.
+    // The points and weights must remain unchanged
+    // whilst the transform is being used.
+    this->points  = points;
+    this->weights = weights;
+    this->count   = count;
+    this->dims    = dims;
+    this->h2      = h2;
+    direct        = true;
+    centers.clear();
+    cutoff.clear();
+    coeffs.clear();
+    if (count == 0 || tolerance <= 0) return;
+
+    // Clusters whos center is further than their radius plus
+    // r_cut from y contribute less than tolerance/2 per unit weight
+    double h     = sqrt(h2);
+    double r_cut = h * sqrt(log(2/tolerance));
+
+    // Farthest-point clustering, choosing the number of
+    // clusters and the expansion order which minimise the
+    // cost of evaluation as we add clusters. The truncation
+    // error of an order p expansion is at most
+    // (2^p/p!) (r_x r_y/h2)^p per unit weight, where r_x is the
+    // cluster radius and r_y is the distance from y to the
+    // cluster center. We use expansions for r_y up to the
+    // diameter of the set of points (clusters further than
+    // this from y, but within the cutoff, are summed directly).
+    unsigned max_clusters = std::max(1u, unsigned(sqrt(double(count))));
+    max_clusters = std::min(max_clusters, max_cluster_count);
+    std::vector<double>   sq_dist(count, INFINITY);
+    std::vector<unsigned> cluster(count, 0);
+    std::vector<unsigned> center_points;
+    double   diameter  = 0;
+    double   best_cost = double(count) * (dims + 20);
+    unsigned best_k    = 0;
+    unsigned best_p    = 0;
+    unsigned best_t    = 0;
+    double   best_ry   = 0;
+    unsigned next = 0;
+    for (unsigned k=1; k<=max_clusters; ++k)
+    {
+        // Every further cluster costs at least a single term, so
+        // once that exceeds the best cost so far we can stop (this
+        // also stops once the radius falls far enough below the
+        // bandwidth that the expansion is a single term)
+        if (k * (dims + 22) >= best_cost) break;
+
+        center_points.push_back(next);
+        double* c = points + next*dims;
+        double worst = 0;
+        for (unsigned n=0; n<count; ++n)
+        {
+            double r2 = 0;
+            for (unsigned j=0; j<dims; ++j)
+                r2 += (points[n*dims+j]-c[j])*(points[n*dims+j]-c[j]);
+            if (r2 < sq_dist[n])
+            {
+                sq_dist[n] = r2;
+                cluster[n] = k-1;
+            }
+            if (sq_dist[n] > worst)
+            {
+                worst = sq_dist[n];
+                next  = n;
+            }
+        }
+
+        double rx = sqrt(worst);
+        if (k == 1) diameter = 2*rx;
+        double ry = std::min(rx + r_cut, diameter);
+        double bound = 1;
+        double terms = 1;
+        unsigned p = 1;
+        for (; bound*2*rx*ry/(h2*p) > tolerance/2; ++p)
+        {
+            bound *= 2*rx*ry/(h2*p);
+            terms *= double(p + dims)/p;
+            if (terms > max_terms) break;
+        }
+        if (terms > max_terms) continue;
+
+        double cost = k * (2*terms + dims + 20) + 2*terms;
+        if (cost < best_cost)
+        {
+            best_cost = cost;
+            best_k    = k;
+            best_p    = p;
+            best_t    = unsigned(terms + 0.5);
+            best_ry   = ry;
+        }
+    }
+
+    // Direct summation is cheaper
+    if (best_k == 0) return;
+    direct     = false;
+    order      = best_p;
+    term_count = best_t;
+
+    // Assign points to the nearest of the chosen clusters
+    centers.resize(best_k*dims);
+    for (unsigned k=0; k<best_k; ++k)
+        for (unsigned j=0; j<dims; ++j)
+            centers[k*dims+j] = points[center_points[k]*dims+j];
+
+    std::vector<double> cluster_radius(best_k, 0);
+    for (unsigned n=0; n<count; ++n)
+    {
+        double best = INFINITY;
+        for (unsigned k=0; k<best_k; ++k)
+        {
+            double r2 = 0;
+            for (unsigned j=0; j<dims; ++j)
+                r2 += (points[n*dims+j]-centers[k*dims+j])*(points[n*dims+j]-centers[k*dims+j]);
+            if (r2 < best)
+            {
+                best = r2;
+                cluster[n] = k;
+            }
+        }
+        cluster_radius[cluster[n]] = std::max(cluster_radius[cluster[n]], sqrt(best));
+    }
+
+    cutoff.resize(best_k);
+    for (unsigned k=0; k<best_k; ++k)
+        cutoff[k] = (cluster_radius[k] + r_cut)*(cluster_radius[k] + r_cut);
+    expansion_cutoff = best_ry * best_ry;
+
+    // Sort the points by cluster
+    members.resize(count);
+    member_start.assign(best_k+1, 0);
+    for (unsigned n=0; n<count; ++n)
+        member_start[cluster[n]+1] += 1;
+    for (unsigned k=0; k<best_k; ++k)
+        member_start[k+1] += member_start[k];
+    std::vector<unsigned> filled(member_start.begin(), member_start.end()-1);
+    for (unsigned n=0; n<count; ++n)
+        members[filled[cluster[n]]++] = n;
+
+    // Accumulate sum_n |w_n| exp(-|dx|^2/h2) (dx/h)^a
+    // for each cluster, where dx = x_n - center
+    std::vector<double>   v(dims);
+    std::vector<double>   m(term_count);
+    std::vector<unsigned> heads(dims);
+    coeffs.assign(best_k*2*term_count, 0);
+    for (unsigned n=0; n<count; ++n)
+    {
+        unsigned k = cluster[n];
+        double dx2 = 0;
+        for (unsigned j=0; j<dims; ++j)
+        {
+            v[j] = (points[n*dims+j] - centers[k*dims+j])/h;
+            dx2 += v[j]*v[j];
+        }
+        monomials(&v[0], &m[0], &heads[0]);
+
+        double  a = fabs(weights[n]) * exp(-dx2);
+        double* c = &coeffs[(k*2 + (weights[n] > 0 ? 0 : 1))*term_count];
+        for (unsigned t=0; t<term_count; ++t)
+            c[t] += a * m[t];
+    }
+
+    // Multiply by the constants 2^|a|/a! generated in
+    // the same order as the monomials, keeping track of
+    // the powers a of each term
+    std::vector<double>   constants(term_count);
+    std::vector<unsigned> powers(term_count*dims, 0);
+    constants[0] = 1;
+    for (unsigned i=0; i<dims; ++i) heads[i] = 0;
+    unsigned t    = 1;
+    unsigned tail = 1;
+    for (unsigned deg=1; deg<order; ++deg)
+    {
+        for (unsigned i=0; i<dims; ++i)
+        {
+            unsigned head = heads[i];
+            heads[i] = t;
+            for (unsigned j=head; j<tail; ++j)
+            {
+                for (unsigned l=0; l<dims; ++l)
+                    powers[t*dims+l] = powers[j*dims+l];
+                powers[t*dims+i] += 1;
+                constants[t] = constants[j] * 2.0/powers[t*dims+i];
+                ++t;
+            }
+        }
+        tail = t;
+    }
+
+    for (unsigned c=0; c<best_k*2; ++c)
+        for (unsigned t=0; t<term_count; ++t)
+            coeffs[c*term_count+t] *= constants[t];
+}
+
+void gauss_transform :: add_point(double* y, unsigned n, double* result)
+{
+    // Add the contribution of the n^th point at y
+    double r2 = 0;
+    for (unsigned j=0; j<dims; ++j)
+        r2 += (points[n*dims+j]-y[j])*(points[n*dims+j]-y[j]);
+    result[weights[n] > 0 ? 0 : 1] += fabs(weights[n]) * exp(-r2/h2);
+}
+
+void gauss_transform :: evaluate(double* y, double* result)
+{
+    // Evaluate the transform at y
+    result[0] = 0;
+    result[1] = 0;
+
+    if (direct)
+    {
+        for (unsigned n=0; n<count; ++n)
+            add_point(y, n, result);
+        return;
+    }
+
+    // Sum the expansions of the nearby clusters, using
+    // workspace local to this thread (so that the transform
+    // can be evaluated from several threads at once)
+    static thread_local std::vector<double>   v, m;
+    static thread_local std::vector<unsigned> heads;
+    if (v.size() < dims) v.resize(dims);
+    if (m.size() < term_count) m.resize(term_count);
+    if (heads.size() < dims) heads.resize(dims);
+    double h = sqrt(h2);
+    for (unsigned k=0; k<clusters(); ++k)
+    {
+        double dy2 = 0;
+        for (unsigned j=0; j<dims; ++j)
+            dy2 += (y[j]-centers[k*dims+j])*(y[j]-centers[k*dims+j]);
+        if (dy2 > cutoff[k]) continue;
+
+        if (dy2 > expansion_cutoff)
+        {
+            // Too far away for the expansion to
+            // converge, sum the cluster directly
+            for (unsigned i=member_start[k]; i<member_start[k+1]; ++i)
+                add_point(y, members[i], result);
+            continue;
+        }
+
+        for (unsigned j=0; j<dims; ++j)
+            v[j] = (y[j]-centers[k*dims+j])/h;
+        monomials(&v[0], &m[0], &heads[0]);
+
+        double e = exp(-dy2/h2);
+        for (unsigned c=0; c<2; ++c)
+        {
+            double* ck  = &coeffs[(k*2+c)*term_count];
+            double  sum = 0;
+            for (unsigned t=0; t<term_count; ++t)
+                sum += ck[t] * m[t];
+            result[c] += e * sum;
+        }
+    }
+}
+
+TEST_CASE("Fast gauss transform tests", "[gauss_transform]")
+{
+    // Compare the transform to direct summation
+    // for a set of points in a broad gaussian
+    const unsigned count = 4000;
+    const unsigned dims  = 3;
+    std::vector<double> pts(count*dims);
+    std::vector<double> w(count);
+    for (unsigned i=0; i<count*dims; ++i)
+        pts[i] = rand_uniform();
+    for (unsigned i=0; i<count; ++i)
+        w[i] = rand_uniform() - 0.3;
+
+    double h2  = 4.0;
+    double tol = 1e-4;
+    gauss_transform gt;
+    gt.build(&pts[0], &w[0], count, dims, h2, tol);
+    REQUIRE(!gt.direct);
+
+    double total[2] = {0, 0};
+    for (unsigned i=0; i<count; ++i)
+        total[w[i] > 0 ? 0 : 1] += fabs(w[i]);
+
+    for (unsigned q=0; q<10; ++q)
+    {
+        double* y = &pts[q*dims*10];
+        double exact[2] = {0, 0};
+        for (unsigned i=0; i<count; ++i)
+        {
+            double r2 = 0;
+            for (unsigned j=0; j<dims; ++j)
+                r2 += (pts[i*dims+j]-y[j])*(pts[i*dims+j]-y[j]);
+            exact[w[i] > 0 ? 0 : 1] += fabs(w[i]) * exp(-r2/h2);
+        }
+
+        double fast[2];
+        gt.evaluate(y, fast);
+        REQUIRE(fabs(fast[0] - exact[0]) <= tol * total[0]);
+        REQUIRE(fabs(fast[1] - exact[1]) <= tol * total[1]);
+    }
+
+    // A narrow gaussian should fall back to direct summation
+    gt.build(&pts[0], &w[0], count, dims, 1e-4, tol);
+    REQUIRE(gt.direct);
+}
@@ -0,0 +1,85 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __GAUSS_TRANSFORM__
+#define __GAUSS_TRANSFORM__
+
+#include <vector>
+
+// An improved fast gauss transform (IFGT), which evaluates
+//
+//   G(y) = sum_n |w_n| exp(-|y - x_n|^2/h2)
+//
+// seperately over the points x_n with positive and negative
+// weights w_n, to within tolerance times the total weight
+// of each sign. The points are grouped into clusters and the
+// contribution of each cluster is expanded as a taylor series
+// about it's center, so evaluation costs O(clusters * terms)
+// rather than O(points). If the expansion would be more
+// expensive than summing over the points directly (for
+// example if h2 is small compared to the spread of the
+// points), the transform falls back to direct summation.
+class gauss_transform
+{
+public:
+    void build(double* points, double* weights, unsigned count,
+               unsigned dims, double h2, double tolerance);
+
+    // Evaluate G(y), result[0] <=> positive weights
+    //                result[1] <=> negative weights
+    void evaluate(double* y, double* result);
+
+    double h2 = 0;
+    bool direct = true;
+    unsigned clusters() { return centers.size()/dims; }
+    unsigned terms() { return term_count; }
+
+private:
+
+    void monomials(double* v, double* m, unsigned* heads);
+    void add_point(double* y, unsigned n, double* result);
+
+    double* points = nullptr;
+    double* weights = nullptr;
+    unsigned count = 0;
+    unsigned dims = 0;
+
+    // Cluster centers stored as [cluster][dimension], the
+    // squared cutoff distance from each center beyond which the
+    // cluster is neglected, and the expansion coefficients
+    // stored as [cluster][positive/negative][term]
+    std::vector<double> centers;
+    std::vector<double> cutoff;
+    std::vector<double> coeffs;
+
+    // The squared distance from a cluster center
+    // beyond which it's expansion is not used
+    double expansion_cutoff = 0;
+
+    // The points in the k^th cluster are
+    // members[member_start[k], member_start[k+1])
+    std::vector<unsigned> members;
+    std::vector<unsigned> member_start;
+
+    // Terms in the expansion (all monomials of degree < order)
+    unsigned order = 0;
+    unsigned term_count = 0;
+};
+
+#endif
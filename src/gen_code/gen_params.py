@@ -159,8 +159,12 @@ def gen_params_cpp():
                     f.write(ws+"// Parse {0}\n".format(p["in_name"]))
                     f.write(ws+'if (tag == "{0}")\n'.format(p["in_name"]))
                     f.write(ws+"{\n")
-                    f.write(ws+"    std::stringstream ss(split[1]);\n")
-                    f.write(ws+"    ss >> params::{0};\n".format(p["cpp_name"]))
+                    if p["type"] == "bool":
+                        # Accept true/false as well as 1/0
+                        f.write(ws+'    params::{0} = (split[1] == "true" || split[1] == "1");\n'.format(p["cpp_name"]))
+                    else:
+                        f.write(ws+"    std::stringstream ss(split[1]);\n")
+                        f.write(ws+"    ss >> params::{0};\n".format(p["cpp_name"]))
                     if not "allowed" in p:
                         f.write(ws+"    continue;\n")
                         f.write(ws+"}\n\n")
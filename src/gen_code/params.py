@@ -18,7 +18,7 @@ params = [{
     "type"        : "std::string",
     "cpp_name"    : "run_mode",
     "default"     : '"calculation"',
-    "description" : "The type of execution running.",
+    "description" : "The type of execution running (calculation, help, test or benchmark).",
 },{
     "in_name"     : "dimensions",
     "type"        : "unsigned",
@@ -91,6 +91,59 @@ params = [{
     "description" : ("How much a walker contributes to it's own diffused "
                      "wavefunction. 1.0 <=> the same as other walkers. 0.0 "
                      " <=> not at all.")
+},{
+    "in_name"     : "psi_d_tolerance",
+    "type"        : "double",
+    "cpp_name"    : "psi_d_tolerance",
+    "default"     : "0.0",
+    "allowed"     : "between 0.0 1.0",
+    "description" : ("Relative error tolerance used when evaluating the diffused "
+                     "wavefunction. Contributions from distant walkers are neglected, "
+                     "so that only nearby walkers (found using a k-d tree) need be "
+                     "visited, such that the neglected contributions add up to at "
+                     "most this fraction of that of the nearest walker (and so of "
+                     "psi_D, if the walkers all have the same sign). 0.0 <=> sum "
+                     "over all walkers.")
+},{
+    "in_name"     : "psi_d_engine",
+    "type"        : "std::string",
+    "cpp_name"    : "psi_d_engine",
+    "default"     : '"direct"',
+    "allowed"     : "strings direct batched gauss_transform",
+    "description" : ("How the diffused wavefunction is evaluated by the "
+                     "stochastic_nodes* and max_seperation* diffusion schemes. "
+                     "direct <=> sum over walkers (see psi_d_tolerance). "
+                     "batched <=> sum over walkers for every walker at once "
+                     "using a blocked kernel (stochastic_nodes and "
+                     "max_seperation only). gauss_transform <=> improved fast "
+                     "gauss transform, accurate to within "
+                     "gauss_transform_tolerance (falls back to direct when "
+                     "this would be faster). The latter is fastest when "
+                     "tau_nodes is large.")
+},{
+    "in_name"     : "gauss_transform_tolerance",
+    "type"        : "double",
+    "cpp_name"    : "gauss_transform_tolerance",
+    "default"     : "1e-4",
+    "allowed"     : "between 0.0 1.0",
+    "description" : ("The error allowed in each of the positive and negative "
+                     "parts of the diffused wavefunction when psi_d_engine = "
+                     "gauss_transform. This is an absolute error per unit of "
+                     "the total |weight| of the walkers of that sign (times the "
+                     "normalization of the greens function), not a relative "
+                     "error, so near the nodal surface (where the two parts "
+                     "almost cancel) it can flip the sign of the diffused "
+                     "wavefunction used by the stochastic_nodes schemes.")
+},{
+    "in_name"     : "exp_method",
+    "type"        : "std::string",
+    "cpp_name"    : "exp_method",
+    "default"     : '"exact"',
+    "allowed"     : "strings exact fast",
+    "description" : ("How the exponentials in the diffused wavefunction are "
+                     "evaluated. exact <=> the standard library exp. fast <=> "
+                     "a polynomial approximation (relative error < 1e-13) "
+                     "vectorized using AVX-512/AVX2 where available.")
 },{
     "in_name"     : "energy_estimator",
     "type"        : "std::string",
@@ -152,6 +205,25 @@ params = [{
                      "iterations. If working with a system with coulomb interactions "
                      "use max_weight in conjunction with coulomb_softening for best "
                      "results.")
+},{
+    "in_name"     : "seed",
+    "type"        : "unsigned long",
+    "cpp_name"    : "seed",
+    "default"     : "1",
+    "description" : ("The seed for the random number generator. Each MPI process "
+                     "(and thread) draws from an independent stream of random "
+                     "numbers generated from this seed."),
+},{
+    "in_name"     : "threads",
+    "type"        : "unsigned",
+    "cpp_name"    : "threads",
+    "default"     : "1",
+    "allowed"     : "positive",
+    "description" : ("The number of threads used by each MPI process to "
+                     "diffuse walkers and evaluate the diffused wavefunction. "
+                     "Each thread draws from it's own stream of random numbers, "
+                     "so results are reproducible for a given seed, number of "
+                     "processes and number of threads."),
 },{
     "type"        : "int",
     "cpp_name"    : "np",
@@ -162,6 +234,13 @@ params = [{
     "cpp_name"    : "pid",
     "default"     : "0",
     "description" : "The MPI process id of this process. Will be in [0,np).",
+},{
+    "type"        : "int",
+    "cpp_name"    : "mpi_thread_support",
+    "default"     : "0",
+    "description" : ("The level of thread support provided by MPI (as returned by "
+                     "MPI_Init_thread). Without MPI_THREAD_FUNNELED, one thread per "
+                     "process is used."),
 },{
     "in_name"     : "trial_energy",
     "type"        : "double",
@@ -176,6 +255,94 @@ params = [{
     "cpp_name"    : "cancelled_weight",
     "default"     : "0.0",
     "description" : ("The total amount of weight cancelled in the last iteration.")
+},{
+    "in_name"     : "checkpoint_interval",
+    "type"        : "unsigned",
+    "cpp_name"    : "checkpoint_interval",
+    "default"     : "0",
+    "description" : ("The number of iterations between checkpoints of the full DMC "
+                     "state (written to the file 'checkpoint'). 0 => no checkpoints.")
+},{
+    "in_name"     : "restart",
+    "type"        : "bool",
+    "cpp_name"    : "restart",
+    "default"     : "false",
+    "description" : ("If true, continue the calculation from the file 'checkpoint', "
+                     "appending to the existing output files (after cutting them "
+                     "back to where they were when the checkpoint was written). "
+                     "The restarted run may use a different number of processes.")
+},{
+    "type"        : "int",
+    "cpp_name"    : "restart_iteration",
+    "default"     : "0",
+    "description" : "The iteration that the calculation was restarted from (0 if not restarted).",
+},{
+    "type"        : "unsigned",
+    "cpp_name"    : "stream_generation",
+    "default"     : "0",
+    "description" : ("The number of times that new random streams have been started "
+                     "on restart, which selects the range of stream ids in use."),
+},{
+    "in_name"     : "load_balance",
+    "type"        : "bool",
+    "cpp_name"    : "load_balance",
+    "default"     : "true",
+    "description" : ("If true, walkers are migrated between processes after "
+                     "branching so that each process has the same number of walkers "
+                     "(to within one).")
+},{
+    "type"        : "double",
+    "cpp_name"    : "load_imbalance",
+    "default"     : "1.0",
+    "description" : ("The largest population on any process divided by the average "
+                     "population per process, after branching in the last iteration "
+                     "(before load balancing).")
+},{
+    "type"        : "int",
+    "cpp_name"    : "walkers_migrated",
+    "default"     : "0",
+    "description" : ("The number of walkers moved between processes by load balancing "
+                     "in the last iteration.")
+},{
+    "type"        : "double",
+    "cpp_name"    : "mixed_energy",
+    "default"     : "0.0",
+    "description" : ("The mixed estimate of the energy in the last iteration (the "
+                     "average potential energy of the walkers, weighted by the "
+                     "modulus of their weights)."),
+},{
+    "type"        : "double",
+    "cpp_name"    : "growth_energy",
+    "default"     : "0.0",
+    "description" : ("The growth estimate of the energy in the last iteration, "
+                     "log(W_before/W_after)/tau, from the total modulus of the "
+                     "walker weights before and after their greens functions "
+                     "(excluding renormalization)."),
+},{
+    "in_name"     : "reblock_start",
+    "type"        : "unsigned",
+    "cpp_name"    : "reblock_start",
+    "default"     : "0",
+    "description" : ("The energy estimates are reblocked, to give their mean, "
+                     "standard error and correlation time in the progress file, "
+                     "on iterations after this one (so that equilibration can be "
+                     "excluded)."),
+},{
+    "in_name"     : "reblock_interval",
+    "type"        : "unsigned",
+    "cpp_name"    : "reblock_interval",
+    "default"     : "100",
+    "description" : ("The reblocked energy estimates are written to the progress "
+                     "file every reblock_interval iterations, and at the end of "
+                     "the calculation (0 <=> only at the end)."),
+},{
+    "in_name"     : "target_error",
+    "type"        : "double",
+    "cpp_name"    : "target_error",
+    "default"     : "0.0",
+    "description" : ("If positive, the calculation stops early once the reblocked "
+                     "standard error of the trial energy is below this (in Hartree) "
+                     "and the reblocking has converged (see reblock_start)."),
 },{
     "in_name"     : "pre_diffusion",
     "type"        : "double",
@@ -191,6 +358,91 @@ params = [{
     "cpp_name"    : "write_wavefunction",
     "default"     : "true",
     "description" : "True if wavefunction files are to be written.",
+},{
+    "in_name"     : "wavefunction_format",
+    "type"        : "std::string",
+    "cpp_name"    : "wavefunction_format",
+    "default"     : '"binary"',
+    "allowed"     : "strings binary binary_float text",
+    "description" : ("The format of the wavefunction files. binary <=> a header "
+                     "describing the particles, followed by a block for each "
+                     "iteration written, containing the weights and then the "
+                     "configurations of the walkers as raw little-endian doubles. "
+                     "binary_float <=> as binary, but with single precision "
+                     "values. text <=> one line per walker, in the form "
+                     "weight: x1, y1, z1 ...; x2, y2, z2 ...; ... "
+                     "(see src/scripts/parser.py, which reads all three)."),
+},{
+    "in_name"     : "wavefunction_interval",
+    "type"        : "unsigned",
+    "cpp_name"    : "wavefunction_interval",
+    "default"     : "1",
+    "allowed"     : "positive",
+    "description" : "The wavefunction is written every wavefunction_interval iterations.",
+},{
+    "in_name"     : "output_flush_interval",
+    "type"        : "double",
+    "cpp_name"    : "output_flush_interval",
+    "default"     : "1.0",
+    "allowed"     : "positive",
+    "description" : ("The longest time, in seconds, that output is buffered in "
+                     "memory before a background thread writes it to disk. Output "
+                     "is also written on exit or error."),
+},{
+    "in_name"     : "trace",
+    "type"        : "bool",
+    "cpp_name"    : "trace",
+    "default"     : "false",
+    "description" : ("True if the time spent in each phase of each iteration is "
+                     "written to trace_pid.json for each process, in the Chrome "
+                     "trace format (viewable in chrome://tracing or "
+                     "https://ui.perfetto.dev)."),
+},{
+    "in_name"     : "mpi_profile",
+    "type"        : "bool",
+    "cpp_name"    : "mpi_profile",
+    "default"     : "false",
+    "description" : ("True if the number of MPI calls made, the bytes communicated "
+                     "and the time spent blocked in them are recorded for each call "
+                     "site on each process, and summarised in the progress file at "
+                     "the end of the calculation."),
+},{
+    "in_name"     : "density_bins",
+    "type"        : "unsigned",
+    "cpp_name"    : "density_bins",
+    "default"     : "0",
+    "description" : ("The number of bins in each dimension of the particle density "
+                     "histograms accumulated during the calculation, on a grid "
+                     "covering [-density_range, density_range] in each dimension. A "
+                     "density is written to density_s for each species s of "
+                     "identical particles at the end of the calculation "
+                     "(0 <=> no densities are accumulated). Walkers are binned by the "
+                     "magnitude of their weight, so the densities are those of |psi| "
+                     "(not |psi|^2), normalized to the number of particles within the grid."),
+},{
+    "in_name"     : "density_range",
+    "type"        : "double",
+    "cpp_name"    : "density_range",
+    "default"     : "4.0",
+    "allowed"     : "positive",
+    "description" : "The extent of the density grid in each dimension (see density_bins).",
+},{
+    "in_name"     : "density_start",
+    "type"        : "unsigned",
+    "cpp_name"    : "density_start",
+    "default"     : "0",
+    "description" : ("Densities are accumulated on iterations after this one "
+                     "(so that equilibration can be excluded)."),
+},{
+    "in_name"     : "pair_densities",
+    "type"        : "bool",
+    "cpp_name"    : "pair_densities",
+    "default"     : "false",
+    "description" : ("True if pair densities, of the seperation x_j - x_i of "
+                     "particle j in species t from particle i in species s, are "
+                     "also accumulated (on the density grid) and written to "
+                     "pair_density_s_t for each s <= t. These can be used to "
+                     "evaluate exchange-correlation holes."),
 },{
     "in_name"     : "write_nodal_surface",
     "type"        : "bool",
@@ -208,15 +460,10 @@ params = [{
                      "at random. (1 - this) is the probability of simply diffusing, "
                      "making no exchange moves."),
 },{
-    "type"        : "int",
-    "cpp_name"    : "start_clock",
-    "default"     : "0",
-    "description" : "The result of clock() called at program start."
-},{
-    "type"        : "int",
-    "cpp_name"    : "dmc_start_clock",
+    "type"        : "double",
+    "cpp_name"    : "dmc_start_time",
     "default"     : "0",
-    "description" : "The result of clock() called just before first DMC iteration."
+    "description" : "The result of wall_time() called just before first DMC iteration."
 },{
     "type"        : "int",
     "cpp_name"    : "argc",
@@ -27,11 +27,17 @@
 #include "params.h"
 #include "particle.h"
 #include "walker.h"
+#include "walker_collection.h"
+#include "random.h"
+#include "utils.h"
+#include "timers.h"
+#include "mpi_profile.h"
 
-using namespace params;
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-// The value of clock() at startup
-int start_clock;
+using namespace params;
 
 PYTHON_GEN_PARAMS_HERE
 
@@ -46,6 +52,7 @@ output_file params::wavefunction_file;
 output_file params::evolution_file;
 output_file params::progress_file;
 output_file params::error_file;
+output_file params::trace_file;
 
 // Split a string on whitespace
 std::vector<std::string> split_whitespace(std::string to_split)
@@ -99,16 +106,40 @@ bool check_params()
     return true;
 }
 
-// Parse the input file.
-bool read_input()
+// Free the system (particles, potentials etc.)
+void free_system()
 {
-    // Open the input file
-    std::ifstream input("input");
-    if (!input.is_open())
-    {
-        params::error_file << "Error: could not read input file!\n";
-        return false;
-    }
+    // Free memory used in exchange groups 
+    for (unsigned i=0; i<exchange_groups.size(); ++i)
+        delete exchange_groups[i];
+    exchange_groups.clear();
+
+    // Free memory in template_system
+    for (unsigned i=0; i<template_system.size(); ++i)
+        delete template_system[i];
+    template_system.clear();
+
+    // Free memory in potentials
+    for (unsigned i=0; i<potentials.size(); ++i)
+        delete potentials[i];
+    potentials.clear();
+
+    // Free the lattice
+    for (unsigned i=0; i<periodicity; ++i)
+        delete[] lattice[i];
+    delete[] lattice;
+    lattice     = nullptr;
+    periodicity = 0;
+
+    // Free recycled walker storage (sized for this system)
+    walker::free_pool();
+}
+
+// Parse input, in the format of the input file
+bool params::read_input(std::istream& input)
+{
+    // Replace any existing system
+    free_system();
 
     for (std::string line; getline(input, line); )
     {
@@ -183,8 +214,6 @@ bool read_input()
                        << line << "'\n";
     }
 
-    input.close();
-
     // Record exchange groups within the system
     bool in_group[template_system.size()];
     for (unsigned i=0; i<template_system.size(); ++i)
@@ -237,14 +266,14 @@ exchange_group :: ~exchange_group() { if (perms != nullptr) delete perms; }
 // Add a particle index to an exchange group
 void exchange_group :: add(unsigned index) { particles.push_back(index); }
 
-int exchange_group :: weight_mult(unsigned perm_index)
+int exchange_group :: weight_mult(double perm_sign)
 {
     // Bosonic exhcnage => weight stays the same
     if (this->sign == 1)
         return 1;
     
     // Odd fermionic permutations => weight -> weight * -1
-    if (this->perms->sign(perm_index) == -1)
+    if (perm_sign < 0)
         return -1;
     
     // Even fermionic permutations => weight stays the same
@@ -282,9 +311,12 @@ std::string exchange_group :: one_line_summary()
 {
     // Return a simple description of the exchange group
     std::stringstream s;
-    s << "Sign = " << sign
-      << ", permutations = " << perms->size() 
-      << ", particles = {";
+    s << "Sign = " << sign << ", permutations = ";
+    if (perms->elements() > permutations<unsigned>::max_elements)
+        s << perms->elements() << "!";
+    else
+        s << perms->size();
+    s << ", particles = {";
     for (unsigned i=0; i<particles.size(); ++i)
         s << particles[i] << " ";
     s << "\b}";
@@ -343,6 +375,7 @@ void output_sim_details()
                  << template_system[i]->one_line_description() << "\n";
 
     // Output a summary of the exchange groups
+    const unsigned long max_listed_permutations = 120;
     progress_file << "\nExchange groups:\n";
     if (exchange_groups.size() == 0)
         progress_file << "    None";
@@ -355,13 +388,24 @@ void output_sim_details()
                           << eg->pairs[j].first << " <--> " 
                           << eg->pairs[j].second << "\n";
 
+        // Permutations are generated on demand, only
+        // list them for reasonably small groups
+        if (eg->perms->elements() > permutations<unsigned>::max_elements ||
+            eg->perms->size() > max_listed_permutations)
+        {
+            progress_file << "    Permutations: too many to list\n";
+            continue;
+        }
+
         progress_file << "    Permutations:\n";
+        unsigned perm[eg->perms->elements()];
         for (unsigned j=0; j<eg->perms->size(); ++j)
         {
+            double sign = eg->perms->unrank(j, perm);
             progress_file << "        p = {";
             for (unsigned k=0; k<eg->perms->elements(); ++k)
-                progress_file << (*eg->perms)[j][k] << " ";
-            progress_file << "\b} " << " sign = " << eg->perms->sign(j) << "\n";
+                progress_file << perm[k] << " ";
+            progress_file << "\b} " << " sign = " << sign << "\n";
         }
     }
 
@@ -370,18 +414,21 @@ void output_sim_details()
 
 void params::initialize()
 {
-    // Used for timing info
-    start_clock = clock();
-
-    // Initialize mpi
-    if (MPI_Init(&argc, &argv) != 0) exit(MPI_ERROR);
+    // Initialize mpi (only the main thread makes MPI calls)
+    if (MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &mpi_thread_support) != 0)
+        exit(MPI_ERROR);
 
     // Get the number of processes and my id within them
     if (MPI_Comm_size(MPI_COMM_WORLD, &np)  != 0) exit(MPI_ERROR);
     if (MPI_Comm_rank(MPI_COMM_WORLD, &pid) != 0) exit(MPI_ERROR);
 
-    // Seed random number generator
-    srand(pid*clock());
+    // Processes measure time from the same
+    // moment, so that their traces line up
+    MPI_Barrier(MPI_COMM_WORLD);
+    start_wall_time();
+
+    // Each process draws from it's own random stream
+    seed_random(seed, pid);
 }
 
 bool params::load(int argc, char** argv)
@@ -399,9 +446,38 @@ bool params::load(int argc, char** argv)
     error_file.auto_flush = true;
     wavefunction_file.open("wavefunction_"+std::to_string(pid));
     nodal_surface_file.open("nodal_surface_"+std::to_string(pid));
+    trace_file.open("trace_"+std::to_string(pid)+".json");
 
     // Read our input and setup parameters accordingly 
-    bool input_success = read_input();
+    bool input_success = false;
+    std::ifstream input("input");
+    if (input.is_open())
+        input_success = read_input(input);
+    else
+        error_file << "Error: could not read input file!\n";
+    output_file::flush_interval = output_flush_interval;
+
+    // Continue the output of a restarted calculation
+    if (restart)
+    {
+        progress_file.append     = true;
+        evolution_file.append    = true;
+        wavefunction_file.append = true;
+    }
+
+    // Use one thread per process if MPI can't be
+    // called from within a multithreaded process
+    bool threads_limited = threads > 1 && mpi_thread_support < MPI_THREAD_FUNNELED;
+    if (threads_limited) threads = 1;
+
+    // Set the number of threads per process, each of
+    // which draws from it's own random stream
+#ifdef _OPENMP
+    omp_set_dynamic(0);
+    omp_set_num_threads(threads);
+#endif
+    #pragma omp parallel num_threads(threads)
+    seed_random(seed, pid*threads + thread_id());
 
     // Check all processes succeeded
     bool all_success = false;
@@ -412,6 +488,14 @@ bool params::load(int argc, char** argv)
         return false;
     }
 
+    // Cut the output of a restarted calculation
+    // back to where the checkpoint was written
+    if (restart) walker_collection::truncate_output("checkpoint");
+
+    if (threads_limited)
+        progress_file << "MPI does not support MPI_THREAD_FUNNELED, "
+                      << "using one thread per process\n";
+
     // Output parameters to the progress file
     output_sim_details();
 
@@ -429,22 +513,18 @@ void params::print_usage_info()
 
 void params::free_memory()
 {
+    // Summarise the MPI calls made by all processes
+    write_mpi_profile();
+
     // Close various output files
     progress_file.close();
     evolution_file.close();
     wavefunction_file.close();
+    end_trace();
+    trace_file.close();
 
-    // Free memory used in exchange groups 
-    for (unsigned i=0; i<exchange_groups.size(); ++i)
-        delete exchange_groups[i];
-
-    // Free memory in template_system
-    for (unsigned i=0; i<template_system.size(); ++i)
-        delete template_system[i];
-
-    // Free memory in potentials
-    for (unsigned i=0; i<potentials.size(); ++i)
-        delete potentials[i];
+    // Free the system
+    free_system();
 
     // Output info on objects that werent deconstructed properly
     if (walker::constructed_count != 0 || particle::constructed_count != 0)
@@ -468,13 +548,13 @@ void params :: flush()
 double params :: time()
 {
     // Return the time in seconds since startup
-    return double(clock()-start_clock)/double(CLOCKS_PER_SEC);
+    return wall_time();
 }
 
 double params :: dmc_time()
 {
     // Return the time that the DMC algorithm has
     // been running (excluding setup time)
-    return double(clock()-dmc_start_clock)/double(CLOCKS_PER_SEC);
+    return wall_time() - dmc_start_time;
 }
 
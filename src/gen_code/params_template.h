@@ -37,7 +37,7 @@ public:
     ~exchange_group();
 
     int sign;
-    int weight_mult(unsigned permutation);
+    int weight_mult(double permutation_sign);
     std::vector<unsigned> particles;
     std::vector<std::pair<unsigned,unsigned>> pairs;
     permutations<unsigned>* perms;
@@ -75,6 +75,7 @@ namespace params
     extern output_file evolution_file;
     extern output_file progress_file;
     extern output_file error_file;
+    extern output_file trace_file;
 
     //%%%%%%%%%%%//
     // FUNCTIONS //
@@ -89,13 +90,17 @@ namespace params
     // Loads system from input, opens output files etc.
     bool load(int argc, char** argv);
 
+    // Replaces the system, and sets any parameters given, by
+    // parsing input in the format of the input file
+    bool read_input(std::istream& input);
+
     // Closes output files and frees template_system and potentials
     void free_memory();
 
     // Flush output files so we have information if a run terminates
     void flush();
 
-    // Get the time since startup
+    // Get the (wall-clock) time since startup
     double time();
 
     // Get the time DMC iterations have been running
@@ -0,0 +1,188 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "catch.h"
+#include "random.h"
+#include "kd_tree.h"
+
+void kd_tree :: build(double* points, unsigned count, unsigned dims)
+{
+    // Build the tree over the given points
+    this->points      = points;
+    this->point_count = count;
+    this->dims        = dims;
+
+    nodes.clear();
+    bounds.clear();
+    order.resize(count);
+    for (unsigned i=0; i<count; ++i)
+        order[i] = i;
+
+    if (count > 0) build_node(0, count);
+}
+
+int kd_tree :: build_node(unsigned begin, unsigned end)
+{
+    // Build the node covering the points order[begin, end)
+    // returning it's index in nodes
+    int n = nodes.size();
+    nodes.push_back(node{begin, end, -1, -1});
+
+    // Work out the bounding box of the points
+    bounds.resize(bounds.size() + 2*dims);
+    double* lo = &bounds[2*n*dims];
+    double* hi = lo + dims;
+    for (unsigned j=0; j<dims; ++j)
+    {
+        lo[j] = points[order[begin]*dims+j];
+        hi[j] = lo[j];
+    }
+    for (unsigned i=begin+1; i<end; ++i)
+        for (unsigned j=0; j<dims; ++j)
+        {
+            double xj = points[order[i]*dims+j];
+            if (xj < lo[j]) lo[j] = xj;
+            if (xj > hi[j]) hi[j] = xj;
+        }
+
+    if (end - begin <= leaf_size)
+        return n;
+
+    // Split at the median along the widest dimension
+    unsigned split_dim = 0;
+    for (unsigned j=1; j<dims; ++j)
+        if (hi[j] - lo[j] > hi[split_dim] - lo[split_dim])
+            split_dim = j;
+
+    unsigned mid  = begin + (end - begin)/2;
+    double* pts   = points;
+    unsigned d    = dims;
+    std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end,
+        [pts, d, split_dim](unsigned a, unsigned b)
+        { return pts[a*d+split_dim] < pts[b*d+split_dim]; });
+
+    // Note: nodes may be reallocated by the recursion
+    int left  = build_node(begin, mid);
+    int right = build_node(mid, end);
+    nodes[n].left  = left;
+    nodes[n].right = right;
+    return n;
+}
+
+double kd_tree :: nearest_sq_distance(double* x, unsigned* nearest)
+{
+    // Return the squared distance from x to
+    // the nearest point in the tree
+    double best = INFINITY;
+    unsigned best_index = 0;
+    if (nodes.empty()) return best;
+
+    // Nodes left to visit (local to this thread)
+    static thread_local std::vector<int> stack;
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        int n = stack.back();
+        stack.pop_back();
+
+        // Skip nodes that cannot contain a closer point
+        if (sq_distance_to_box(n, x) >= best)
+            continue;
+
+        if (nodes[n].left < 0)
+        {
+            // Leaf node, check the points
+            for (unsigned i=nodes[n].begin; i<nodes[n].end; ++i)
+            {
+                double* p = points + order[i]*dims;
+                double r2 = 0;
+                for (unsigned j=0; j<dims; ++j)
+                    r2 += (p[j]-x[j])*(p[j]-x[j]);
+                if (r2 < best)
+                {
+                    best       = r2;
+                    best_index = order[i];
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first
+        int near = nodes[n].left;
+        int far  = nodes[n].right;
+        if (sq_distance_to_box(far, x) < sq_distance_to_box(near, x))
+            std::swap(near, far);
+        stack.push_back(far);
+        stack.push_back(near);
+    }
+    if (nearest != nullptr) *nearest = best_index;
+    return best;
+}
+
+TEST_CASE("k-d tree tests", "[kd_tree]")
+{
+    // Check that every point within the cutoff
+    // is visited, and that none are visited twice
+    const unsigned count = 500;
+    const unsigned dims  = 3;
+    std::vector<double> pts(count*dims);
+    for (unsigned i=0; i<count*dims; ++i)
+        pts[i] = rand_uniform();
+
+    kd_tree tree;
+    tree.build(&pts[0], count, dims);
+    REQUIRE(tree.size() == count);
+
+    double x[dims] = {0.5, 0.2, 0.7};
+    double r2_max  = 0.05;
+    std::vector<int> visited(count, 0);
+    tree.for_each_candidate(x, r2_max, [&visited](unsigned n){ visited[n] += 1; });
+
+    unsigned missed  = 0;
+    unsigned twice   = 0;
+    unsigned total   = 0;
+    double   nearest = INFINITY;
+    unsigned nearest_index = 0;
+    for (unsigned i=0; i<count; ++i)
+    {
+        double r2 = 0;
+        for (unsigned j=0; j<dims; ++j)
+            r2 += (pts[i*dims+j]-x[j])*(pts[i*dims+j]-x[j]);
+        if (r2 < nearest)
+        {
+            nearest       = r2;
+            nearest_index = i;
+        }
+        if (r2 <= r2_max && visited[i] == 0) ++missed;
+        if (visited[i] > 1) ++twice;
+        total += visited[i];
+    }
+    REQUIRE(missed == 0);
+    REQUIRE(twice  == 0);
+    unsigned found;
+    REQUIRE(tree.nearest_sq_distance(x, &found) == nearest);
+    REQUIRE(found == nearest_index);
+
+    // The tree should have pruned most of the points
+    REQUIRE(total < count);
+}
@@ -0,0 +1,130 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef __KD_TREE__
+#define __KD_TREE__
+
+#include <vector>
+
+// A k-d tree over a set of points stored contiguously as
+// [point][dimension] (for example, the configurations in a
+// walker_collection). Used to find the points that lie within
+// some cutoff radius of a query point without visiting
+// every point in the set.
+class kd_tree
+{
+public:
+    kd_tree() { point_count = 0; dims = 0; points = nullptr; }
+
+    // (Re)build the tree over the given points. The points must
+    // remain unchanged whilst the tree is being used. Storage is
+    // retained between builds.
+    void build(double* points, unsigned count, unsigned dims);
+    unsigned size() { return point_count; }
+
+    // Return the squared distance from x to the nearest point
+    // in the tree (setting nearest to it's index, if given)
+    double nearest_sq_distance(double* x, unsigned* nearest=nullptr);
+
+    // Call f(n) for every point n that is within a distance
+    // sqrt(r2_max) of x (and possibly for some more points,
+    // which the caller should reject by checking distances).
+    template<class F>
+    void for_each_candidate(double* x, double r2_max, F f);
+
+private:
+
+    // Points per leaf node
+    static const unsigned leaf_size = 8;
+
+    // A node covers the points order[begin, end) and
+    // has children left, right (or -1 for a leaf node)
+    struct node
+    {
+        unsigned begin;
+        unsigned end;
+        int left;
+        int right;
+    };
+
+    int build_node(unsigned begin, unsigned end);
+    double sq_distance_to_box(int node, double* x);
+
+    double* points;
+    unsigned point_count;
+    unsigned dims;
+    std::vector<node> nodes;
+    std::vector<unsigned> order;
+
+    // Bounding box of each node, stored as
+    // [node][min/max][dimension]
+    std::vector<double> bounds;
+};
+
+inline double kd_tree :: sq_distance_to_box(int n, double* x)
+{
+    // Return the squared distance from x to
+    // the bounding box of the n^th node
+    double* lo = &bounds[2*n*dims];
+    double* hi = lo + dims;
+    double r2  = 0;
+    for (unsigned j=0; j<dims; ++j)
+    {
+        double dx = 0;
+        if      (x[j] < lo[j]) dx = lo[j] - x[j];
+        else if (x[j] > hi[j]) dx = x[j] - hi[j];
+        r2 += dx * dx;
+    }
+    return r2;
+}
+
+template<class F>
+void kd_tree :: for_each_candidate(double* x, double r2_max, F f)
+{
+    if (nodes.empty()) return;
+
+    // Nodes left to visit (local to this thread, so
+    // that the tree can be queried from several threads)
+    static thread_local std::vector<int> stack;
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        int n = stack.back();
+        stack.pop_back();
+
+        // Skip nodes whose bounding box is
+        // entirely outside of the cutoff
+        if (sq_distance_to_box(n, x) > r2_max)
+            continue;
+
+        if (nodes[n].left < 0)
+        {
+            // Leaf node, visit the points
+            for (unsigned i=nodes[n].begin; i<nodes[n].end; ++i)
+                f(order[i]);
+            continue;
+        }
+
+        stack.push_back(nodes[n].right);
+        stack.push_back(nodes[n].left);
+    }
+}
+
+#endif
@@ -23,45 +23,157 @@
 #include "particle.h"
 #include "walker_collection.h"
 #include "random.h"
+#include "dmc_math.h"
 #include "constants.h"
 #include "utils.h"
+#include "mpi_utils.h"
+#include "reblocking.h"
+#include "timers.h"
+#include "benchmark.h"
 
 #include <iostream>
 
+// Write the reblocked estimate of an energy to the progress file
+void write_reblocked(std::string name, reblocking& energies)
+{
+    params::progress_file << name << energies.mean() << " +/- " << energies.error()
+        << " Hartree (correlation time " << energies.correlation_time() << " iterations"
+        << (energies.converged() ? "" : ", not yet converged") << ")\n";
+}
+
 // Run the DMC calculation
 void run_dmc()
 {
-    // Our DMC walkers
-    params::progress_file << "Initializing walkers\n";
-    walker_collection* walkers = new walker_collection();
+    // Select the kernels specialised to the number
+    // of dimensions, and the exponential to use
+    walker_collection::select_kernels();
+    select_fexp();
+
+    // Particle densities, accumulated after equilibration
+    density_accumulator densities(params::density_bins, params::density_range,
+                                  params::pair_densities);
+
+    // Reblocking of the energy estimates, after equilibration
+    reblocking trial_energies;
+    reblocking mixed_energies;
+    reblocking growth_energies;
+
+    // Our DMC walkers, and a buffer to propagate them into
+    walker_collection* walkers;
+    params::dmc_iteration = 0;
+    if (params::restart)
+    {
+        // (along with the estimates accumulated so far)
+        params::progress_file << "Reading walkers from checkpoint\n";
+        std::vector<double> state;
+        walkers = walker_collection::read_checkpoint("checkpoint", &state);
+        unsigned position = 0;
+        trial_energies.load_state(state, position);
+        mixed_energies.load_state(state, position);
+        growth_energies.load_state(state, position);
+        densities.load_state(state, position);
+        params::progress_file << "Restarting from iteration " << params::dmc_iteration << "\n";
+    }
+    else
+    {
+        params::progress_file << "Initializing walkers\n";
+        walkers = new walker_collection();
+    }
+    walker_collection* walkers_next = new walker_collection(nullptr);
     
     // Run our DMC iterations
     params::progress_file << "Starting DMC simulation\n";
     params::progress_file << "    Total setup time: " << params::time() << "s\n";
-    params::dmc_start_clock = clock();
+    params::dmc_start_time = wall_time();
 
-    for (params::dmc_iteration = 1;
+    for (params::dmc_iteration += 1;
          params::dmc_iteration <= params::dmc_iterations;
          params::dmc_iteration ++)
     {
-        // Apply propagation of walkers
-        walker_collection* walkers_last = walkers->copy();
-        bool revert = !walkers->propagate(walkers_last);
+        double iteration_start = wall_time();
 
-        if (revert)
+        // Apply propagation of walkers (walkers
+        // is left untouched by the propagation)
+        bool revert = !walkers_next->propagate(walkers);
+
+        if (!revert)
         {
-            // Revert this iteration
-            delete walkers;
-            walkers = walkers_last;
+            // Keep the new walkers, recycling the
+            // old ones as the next buffer
+            walker_collection* tmp = walkers;
+            walkers      = walkers_next;
+            walkers_next = tmp;
+        }
+
+        // Even out the number of walkers on each process
+        // (on every process, whether or not it reverted)
+        {
+            scoped_timer timer(PHASE_LOAD_BALANCE);
+            walkers->balance_load();
         }
-        else
-            // Keep the new walkers
-            delete walkers_last;
 
         // Estimate the new value for tau_nodes
         walkers->estimate_tau_nodes();
 
         walkers->write_output(revert);
+
+        if (params::dmc_iteration > params::reblock_start)
+        {
+            trial_energies.add(params::trial_energy);
+            mixed_energies.add(params::mixed_energy);
+            growth_energies.add(params::growth_energy);
+            if (params::reblock_interval > 0 &&
+                params::dmc_iteration % params::reblock_interval == 0)
+            {
+                write_reblocked("    Reblocked trial    : ", trial_energies);
+                write_reblocked("    Reblocked mixed    : ", mixed_energies);
+                write_reblocked("    Reblocked growth   : ", growth_energies);
+            }
+        }
+
+        if (params::density_bins > 0 && params::dmc_iteration > params::density_start)
+            walkers->accumulate_densities(densities);
+
+        // Checkpoint the calculation
+        if (params::checkpoint_interval > 0 &&
+            params::dmc_iteration % params::checkpoint_interval == 0)
+        {
+            std::vector<double> state;
+            trial_energies.save_state(state);
+            mixed_energies.save_state(state);
+            growth_energies.save_state(state);
+            densities.save_state(state);
+            walkers->write_checkpoint("checkpoint", state);
+        }
+
+        // Stop once the energy is known well enough (all
+        // processes must agree, so that they stop together)
+        if (params::target_error > 0)
+        {
+            int reached = trial_energies.converged() &&
+                          trial_energies.error() < params::target_error;
+            if (mpi_sum(reached) == params::np)
+            {
+                params::progress_file << "\nTarget error reached\n";
+                break;
+            }
+        }
+
+        if (params::trace) trace_event("Iteration", iteration_start, wall_time());
+    }
+
+    // Sum the densities across processes and write them
+    if (params::density_bins > 0)
+        densities.write();
+
+    // Output the final energy estimates
+    if (trial_energies.count() > 0)
+    {
+        params::progress_file << "\nEnergy estimates from the last "
+                              << trial_energies.count() << " iterations:\n";
+        write_reblocked("    Trial energy       : ", trial_energies);
+        write_reblocked("    Mixed energy       : ", mixed_energies);
+        write_reblocked("    Growth energy      : ", growth_energies);
     }
 
     // Output success message
@@ -69,6 +181,7 @@ void run_dmc()
     
     // Free memory
     delete walkers;
+    delete walkers_next;
 }
 
 // Check if arg is requesting help
@@ -91,6 +204,16 @@ bool is_test_arg(std::string arg)
     return false;
 }
 
+// Check if arg is requesting a benchmark
+bool is_benchmark_arg(std::string arg)
+{
+    if (arg == "-b") return true;
+    if (arg == "--b") return true;
+    if (arg == "-benchmark") return true;
+    if (arg == "--benchmark") return true;
+    return false;
+}
+
 // Program entrypoint
 int main(int argc, char** argv)
 {
@@ -102,6 +225,8 @@ int main(int argc, char** argv)
             params::run_mode = "help";
         else if (is_test_arg(arg))
             params::run_mode = "test";
+        else if (is_benchmark_arg(arg))
+            params::run_mode = "benchmark";
     }
 
     // Initialize MPI etc.
@@ -128,6 +253,10 @@ int main(int argc, char** argv)
             }
         }
 
+    // Run benchmarks on synthetic systems
+    else if (params::run_mode == "benchmark")
+        run_benchmark();
+
     // Run the DMC simulation
     else if (params::load(argc, argv)) run_dmc();
 
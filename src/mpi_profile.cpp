@@ -0,0 +1,421 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#include <mpi.h>
+#include <map>
+#include <string>
+#include <sstream>
+#include <cstdio>
+
+#include "catch.h"
+#include "mpi_profile.h"
+#include "mpi_utils.h"
+#include "params.h"
+#include "timers.h"
+
+// The call site MPI calls are currently being made from, and
+// the entries recorded so far (only the main thread makes
+// MPI calls, so these need no synchronization)
+static const char* current_site = "other";
+static std::vector<mpi_profile_entry> entries;
+
+mpi_call_site :: mpi_call_site(const char* name)
+{
+    parent = current_site;
+    current_site = name;
+}
+
+mpi_call_site :: ~mpi_call_site()
+{
+    current_site = parent;
+}
+
+const std::vector<mpi_profile_entry>& mpi_profile_entries()
+{
+    return entries;
+}
+
+static unsigned long long bytes(int count, MPI_Datatype type)
+{
+    // The size of count elements of the given type
+    int size;
+    PMPI_Type_size(type, &size);
+    return (unsigned long long)count * size;
+}
+
+static void record(const char* call, unsigned long long bytes, double start)
+{
+    // Record a call that began at start and has just returned
+    double time = wall_time() - start;
+    for (mpi_profile_entry& e : entries)
+        if (e.site == current_site && e.call == call)
+        {
+            e.calls += 1;
+            e.bytes += bytes;
+            e.time  += time;
+            return;
+        }
+    entries.push_back({current_site, call, 1, bytes, time});
+}
+
+// The MPI functions used by XDMC, which forward to their PMPI
+// versions. These replace the versions in the MPI library at link
+// time. The bytes recorded are those contributed by this process
+// (the send buffer, or the receive buffer for receives).
+extern "C"
+{
+
+int MPI_Bcast(void* buffer, int count, MPI_Datatype type, int root, MPI_Comm comm)
+{
+    if (!params::mpi_profile) return PMPI_Bcast(buffer, count, type, root, comm);
+    double start = wall_time();
+    int err = PMPI_Bcast(buffer, count, type, root, comm);
+    record("MPI_Bcast", bytes(count, type), start);
+    return err;
+}
+
+int MPI_Reduce(const void* send, void* recv, int count, MPI_Datatype type,
+               MPI_Op op, int root, MPI_Comm comm)
+{
+    if (!params::mpi_profile) return PMPI_Reduce(send, recv, count, type, op, root, comm);
+    double start = wall_time();
+    int err = PMPI_Reduce(send, recv, count, type, op, root, comm);
+    record("MPI_Reduce", bytes(count, type), start);
+    return err;
+}
+
+int MPI_Allreduce(const void* send, void* recv, int count, MPI_Datatype type,
+                  MPI_Op op, MPI_Comm comm)
+{
+    if (!params::mpi_profile) return PMPI_Allreduce(send, recv, count, type, op, comm);
+    double start = wall_time();
+    int err = PMPI_Allreduce(send, recv, count, type, op, comm);
+    record("MPI_Allreduce", bytes(count, type), start);
+    return err;
+}
+
+int MPI_Iallreduce(const void* send, void* recv, int count, MPI_Datatype type,
+                   MPI_Op op, MPI_Comm comm, MPI_Request* request)
+{
+    if (!params::mpi_profile) return PMPI_Iallreduce(send, recv, count, type, op, comm, request);
+    double start = wall_time();
+    int err = PMPI_Iallreduce(send, recv, count, type, op, comm, request);
+    record("MPI_Iallreduce", bytes(count, type), start);
+    return err;
+}
+
+int MPI_Allgather(const void* send, int send_count, MPI_Datatype send_type,
+                  void* recv, int recv_count, MPI_Datatype recv_type, MPI_Comm comm)
+{
+    if (!params::mpi_profile)
+        return PMPI_Allgather(send, send_count, send_type, recv, recv_count, recv_type, comm);
+    double start = wall_time();
+    int err = PMPI_Allgather(send, send_count, send_type, recv, recv_count, recv_type, comm);
+    record("MPI_Allgather", bytes(send_count, send_type), start);
+    return err;
+}
+
+int MPI_Allgatherv(const void* send, int send_count, MPI_Datatype send_type, void* recv,
+                   const int recv_counts[], const int displs[], MPI_Datatype recv_type,
+                   MPI_Comm comm)
+{
+    if (!params::mpi_profile)
+        return PMPI_Allgatherv(send, send_count, send_type, recv,
+                               recv_counts, displs, recv_type, comm);
+    double start = wall_time();
+    int err = PMPI_Allgatherv(send, send_count, send_type, recv,
+                              recv_counts, displs, recv_type, comm);
+    record("MPI_Allgatherv", bytes(send_count, send_type), start);
+    return err;
+}
+
+int MPI_Reduce_scatter(const void* send, void* recv, const int recv_counts[],
+                       MPI_Datatype type, MPI_Op op, MPI_Comm comm)
+{
+    if (!params::mpi_profile) return PMPI_Reduce_scatter(send, recv, recv_counts, type, op, comm);
+    double start = wall_time();
+    int err = PMPI_Reduce_scatter(send, recv, recv_counts, type, op, comm);
+    int np, count = 0;
+    PMPI_Comm_size(comm, &np);
+    for (int i=0; i<np; ++i) count += recv_counts[i];
+    record("MPI_Reduce_scatter", bytes(count, type), start);
+    return err;
+}
+
+int MPI_Barrier(MPI_Comm comm)
+{
+    if (!params::mpi_profile) return PMPI_Barrier(comm);
+    double start = wall_time();
+    int err = PMPI_Barrier(comm);
+    record("MPI_Barrier", 0, start);
+    return err;
+}
+
+int MPI_Isend(const void* buf, int count, MPI_Datatype type, int dest,
+              int tag, MPI_Comm comm, MPI_Request* request)
+{
+    if (!params::mpi_profile) return PMPI_Isend(buf, count, type, dest, tag, comm, request);
+    double start = wall_time();
+    int err = PMPI_Isend(buf, count, type, dest, tag, comm, request);
+    record("MPI_Isend", bytes(count, type), start);
+    return err;
+}
+
+int MPI_Irecv(void* buf, int count, MPI_Datatype type, int source,
+              int tag, MPI_Comm comm, MPI_Request* request)
+{
+    if (!params::mpi_profile) return PMPI_Irecv(buf, count, type, source, tag, comm, request);
+    double start = wall_time();
+    int err = PMPI_Irecv(buf, count, type, source, tag, comm, request);
+    record("MPI_Irecv", bytes(count, type), start);
+    return err;
+}
+
+int MPI_Wait(MPI_Request* request, MPI_Status* status)
+{
+    if (!params::mpi_profile) return PMPI_Wait(request, status);
+    double start = wall_time();
+    int err = PMPI_Wait(request, status);
+    record("MPI_Wait", 0, start);
+    return err;
+}
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[])
+{
+    if (!params::mpi_profile) return PMPI_Waitall(count, requests, statuses);
+    double start = wall_time();
+    int err = PMPI_Waitall(count, requests, statuses);
+    record("MPI_Waitall", 0, start);
+    return err;
+}
+
+int MPI_Gather(const void* send, int send_count, MPI_Datatype send_type,
+               void* recv, int recv_count, MPI_Datatype recv_type, int root, MPI_Comm comm)
+{
+    if (!params::mpi_profile)
+        return PMPI_Gather(send, send_count, send_type, recv, recv_count, recv_type, root, comm);
+    double start = wall_time();
+    int err = PMPI_Gather(send, send_count, send_type, recv, recv_count, recv_type, root, comm);
+    record("MPI_Gather", bytes(send_count, send_type), start);
+    return err;
+}
+
+// MPI-IO (used for checkpoints)
+int MPI_File_open(MPI_Comm comm, const char* filename, int mode, MPI_Info info, MPI_File* file)
+{
+    if (!params::mpi_profile) return PMPI_File_open(comm, filename, mode, info, file);
+    double start = wall_time();
+    int err = PMPI_File_open(comm, filename, mode, info, file);
+    record("MPI_File_open", 0, start);
+    return err;
+}
+
+int MPI_File_set_size(MPI_File file, MPI_Offset size)
+{
+    if (!params::mpi_profile) return PMPI_File_set_size(file, size);
+    double start = wall_time();
+    int err = PMPI_File_set_size(file, size);
+    record("MPI_File_set_size", 0, start);
+    return err;
+}
+
+int MPI_File_write_at(MPI_File file, MPI_Offset offset, const void* buf,
+                      int count, MPI_Datatype type, MPI_Status* status)
+{
+    if (!params::mpi_profile) return PMPI_File_write_at(file, offset, buf, count, type, status);
+    double start = wall_time();
+    int err = PMPI_File_write_at(file, offset, buf, count, type, status);
+    record("MPI_File_write_at", bytes(count, type), start);
+    return err;
+}
+
+int MPI_File_write_at_all(MPI_File file, MPI_Offset offset, const void* buf,
+                          int count, MPI_Datatype type, MPI_Status* status)
+{
+    if (!params::mpi_profile) return PMPI_File_write_at_all(file, offset, buf, count, type, status);
+    double start = wall_time();
+    int err = PMPI_File_write_at_all(file, offset, buf, count, type, status);
+    record("MPI_File_write_at_all", bytes(count, type), start);
+    return err;
+}
+
+int MPI_File_read_at_all(MPI_File file, MPI_Offset offset, void* buf,
+                         int count, MPI_Datatype type, MPI_Status* status)
+{
+    if (!params::mpi_profile) return PMPI_File_read_at_all(file, offset, buf, count, type, status);
+    double start = wall_time();
+    int err = PMPI_File_read_at_all(file, offset, buf, count, type, status);
+    record("MPI_File_read_at_all", bytes(count, type), start);
+    return err;
+}
+
+int MPI_File_close(MPI_File* file)
+{
+    if (!params::mpi_profile) return PMPI_File_close(file);
+    double start = wall_time();
+    int err = PMPI_File_close(file);
+    record("MPI_File_close", 0, start);
+    return err;
+}
+
+}
+
+// The totals for one MPI function from one call site,
+// along with the time spent in it on each process
+struct mpi_profile_summary
+{
+    unsigned long long calls = 0;
+    unsigned long long bytes = 0;
+    std::vector<double> times;
+};
+
+void write_mpi_profile()
+{
+    if (!params::mpi_profile) return;
+
+    // Serialize the entries on this process, one per line
+    std::stringstream ss;
+    ss.precision(17);
+    for (const mpi_profile_entry& e : entries)
+        ss << e.site << "\t" << e.call << "\t" << e.calls << "\t"
+           << e.bytes << "\t" << e.time << "\n";
+    std::string local = ss.str();
+
+    // Gather them onto the root process, along with the total time
+    // each process has been running (the PMPI versions are called,
+    // so that this doesn't appear in the profile itself)
+    int length = local.size();
+    double elapsed = params::time();
+    std::vector<int> lengths(params::np);
+    std::vector<int> offsets(params::np);
+    std::vector<double> elapsed_times(params::np);
+    PMPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    PMPI_Gather(&elapsed, 1, MPI_DOUBLE, elapsed_times.data(), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    int total_length = 0;
+    for (int i=0; i<params::np; ++i)
+    {
+        offsets[i] = total_length;
+        total_length += lengths[i];
+    }
+
+    std::string all(total_length, '\0');
+    PMPI_Gatherv(local.data(), length, MPI_CHAR, &all[0], lengths.data(),
+                 offsets.data(), MPI_CHAR, 0, MPI_COMM_WORLD);
+    if (params::pid != 0) return;
+
+    // Combine the entries from each process by call site
+    std::map<std::pair<std::string, std::string>, mpi_profile_summary> summaries;
+    std::vector<mpi_profile_summary> per_process(params::np);
+    std::vector<double> process_times(params::np, 0);
+    for (int i=0; i<params::np; ++i)
+    {
+        std::istringstream lines(all.substr(offsets[i], lengths[i]));
+        std::string site, call;
+        unsigned long long calls, bytes;
+        double time;
+        while (std::getline(lines, site, '\t') && std::getline(lines, call, '\t') &&
+               lines >> calls >> bytes >> time)
+        {
+            lines.ignore(1);
+            mpi_profile_summary& s = summaries[{site, call}];
+            if (s.times.empty()) s.times.resize(params::np, 0);
+            s.calls    += calls;
+            s.bytes    += bytes;
+            s.times[i] += time;
+            per_process[i].calls += calls;
+            per_process[i].bytes += bytes;
+            process_times[i]     += time;
+        }
+    }
+
+    // Per call site, the time is the time blocked in each call (averaged
+    // over processes), and the imbalance is the ratio of the time on the
+    // slowest process to the average, i.e how long processes wait
+    // for the slowest one.
+    char line[256];
+    params::progress_file << "\nMPI profile (times in seconds, bytes summed over processes)\n";
+    snprintf(line, sizeof(line), "%-30s %-22s %12s %14s %12s %12s %8s %10s\n",
+             "Call site", "Call", "Calls", "Bytes", "Mean time", "Max time", "Max pid", "Imbalance");
+    params::progress_file << line;
+    for (const auto& kv : summaries)
+    {
+        const mpi_profile_summary& s = kv.second;
+        double mean = 0;
+        int slowest = 0;
+        for (int i=0; i<params::np; ++i)
+        {
+            mean += s.times[i] / params::np;
+            if (s.times[i] > s.times[slowest]) slowest = i;
+        }
+        snprintf(line, sizeof(line), "%-30s %-22s %12llu %14llu %12.4g %12.4g %8d %10.3g\n",
+                 kv.first.first.c_str(), kv.first.second.c_str(), s.calls, s.bytes,
+                 mean, s.times[slowest], slowest, mean > 0 ? s.times[slowest]/mean : 1.0);
+        params::progress_file << line;
+    }
+
+    // Per process, the total time blocked in MPI
+    // as a fraction of the total run time
+    snprintf(line, sizeof(line), "\n%-8s %12s %14s %12s %12s\n",
+             "Pid", "Calls", "Bytes", "MPI time", "% of total");
+    params::progress_file << line;
+    for (int i=0; i<params::np; ++i)
+    {
+        snprintf(line, sizeof(line), "%-8d %12llu %14llu %12.4g %12.3g\n",
+                 i, per_process[i].calls, per_process[i].bytes, process_times[i],
+                 100 * process_times[i] / elapsed_times[i]);
+        params::progress_file << line;
+    }
+}
+
+TEST_CASE("MPI profile tests", "[mpi_profile]")
+{
+    // Calls should be recorded against the innermost call site
+    bool profile = params::mpi_profile;
+    params::mpi_profile = true;
+    {
+        mpi_call_site outer("profile test");
+        mpi_sum(1.0);
+        {
+            mpi_call_site inner("profile test inner");
+            mpi_sum(1.0);
+        }
+        mpi_sum(1);
+    }
+    params::mpi_profile = profile;
+
+    unsigned found = 0;
+    for (const mpi_profile_entry& e : mpi_profile_entries())
+    {
+        if (std::string(e.site) == "profile test")
+        {
+            REQUIRE(std::string(e.call) == "MPI_Allreduce");
+            REQUIRE(e.calls == 2);
+            REQUIRE(e.bytes == sizeof(double) + sizeof(int));
+            REQUIRE(e.time >= 0);
+            ++found;
+        }
+        if (std::string(e.site) == "profile test inner")
+        {
+            REQUIRE(e.calls == 1);
+            REQUIRE(e.bytes == sizeof(double));
+            ++found;
+        }
+    }
+    REQUIRE(found == 2);
+}
@@ -0,0 +1,60 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#ifndef __MPI_PROFILE__
+#define __MPI_PROFILE__
+
+#include <vector>
+
+// The MPI calls made by XDMC are intercepted (through the PMPI
+// profiling interface, see mpi_profile.cpp) and, if params::mpi_profile
+// is set, the number of calls, the bytes communicated and the time
+// spent blocked in each call are recorded against the call site
+// they were made from.
+
+// Labels the MPI calls made within the enclosing scope as
+// coming from the given call site (nested sites take precedence).
+// The name must outlive the profile, e.g be a string literal.
+class mpi_call_site
+{
+public:
+    mpi_call_site(const char* name);
+    ~mpi_call_site();
+
+private:
+    const char* parent;
+};
+
+// The calls of one MPI function from one call site on this process
+struct mpi_profile_entry
+{
+    const char* site;
+    const char* call;
+    unsigned long long calls;
+    unsigned long long bytes;
+    double time;
+};
+
+// The entries recorded on this process so far
+const std::vector<mpi_profile_entry>& mpi_profile_entries();
+
+// Write a summary of the profiles of all processes, per call site
+// and per process, to the progress file (called on all processes)
+void write_mpi_profile();
+
+#endif
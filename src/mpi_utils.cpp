@@ -21,10 +21,12 @@
 #include "mpi_utils.h"
 #include "params.h"
 #include "catch.h"
+#include "timers.h"
 
 double mpi_average(double val)
 {
     // Get the average of val across proccesses
+    scoped_timer timer(PHASE_MPI_WAIT);
     double res;
     MPI_Allreduce(&val, &res, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
     res /= double(params::np);
@@ -34,6 +36,7 @@ double mpi_average(double val)
 double mpi_sum(double val)
 {
     // Get the sum of val across proccesses
+    scoped_timer timer(PHASE_MPI_WAIT);
     double res;
     MPI_Allreduce(&val, &res, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
     return res;
@@ -42,11 +45,46 @@ double mpi_sum(double val)
 int mpi_sum(int val)
 {
     // Get the sum of val across proccesses
+    scoped_timer timer(PHASE_MPI_WAIT);
     int res;
     MPI_Allreduce(&val, &res, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
     return res;
 }
 
+unsigned mpi_sums :: add(double val)
+{
+    values.push_back(val);
+    return values.size() - 1;
+}
+
+void mpi_sums :: reduce()
+{
+    begin_reduce();
+    wait();
+}
+
+void mpi_sums :: begin_reduce()
+{
+    // Start summing all of the values in one reduction
+    sums.resize(values.size());
+    MPI_Iallreduce(values.data(), sums.data(), values.size(),
+                   MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD, &request);
+}
+
+void mpi_sums :: wait()
+{
+    scoped_timer timer(PHASE_MPI_WAIT);
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+}
+
+double mpi_sums :: average(unsigned i)
+{
+    // Same arithmetic as mpi_average
+    double res = sums[i];
+    res /= double(params::np);
+    return res;
+}
+
 // MPI unit tests
 TEST_CASE("Basic MPI tests", "[mpi]")
 {
@@ -65,5 +103,18 @@ TEST_CASE("Basic MPI tests", "[mpi]")
         double to_average = 1.0;
         REQUIRE(mpi_average(to_average) == 1.0);
     }
+
+    // Test fused sums agree with the individual reductions
+    SECTION("MPI fused sums test")
+    {
+        mpi_sums sums;
+        unsigned i_one = sums.add(1.0);
+        unsigned i_pid = sums.add(double(params::pid));
+        sums.begin_reduce();
+        sums.wait();
+        REQUIRE(sums.sum(i_one) == mpi_sum(1.0));
+        REQUIRE(sums.sum(i_pid) == mpi_sum(double(params::pid)));
+        REQUIRE(sums.average(i_one) == mpi_average(1.0));
+    }
 }
 
@@ -20,9 +20,37 @@
 #ifndef __MPI_UTILS__
 #define __MPI_UTILS__
 
+#include <mpi.h>
+#include <vector>
+
 double mpi_average(double val);
 double mpi_sum(double val);
 int    mpi_sum(int val);
 
+// Accumulates scalars that are to be summed across processes, so
+// that they can all be reduced by a single (possibly non-blocking)
+// collective, rather than one collective per scalar.
+class mpi_sums
+{
+public:
+    // Add a value to be summed, returning it's index
+    unsigned add(double val);
+
+    // Sum the values across processes, either immediately
+    // or by starting a reduction that is completed by wait()
+    void reduce();
+    void begin_reduce();
+    void wait();
+
+    // The sum/average of the i^th value (after the reduction)
+    double sum(unsigned i)     { return sums[i]; }
+    double average(unsigned i);
+
+private:
+    std::vector<double> values;
+    std::vector<double> sums;
+    MPI_Request request = MPI_REQUEST_NULL;
+};
+
 #endif
 
@@ -0,0 +1,282 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include <algorithm>
+#include <vector>
+#include <cstdio>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "catch.h"
+#include "output_file.h"
+#include "params.h"
+
+double output_file::flush_interval = 1.0;
+size_t output_file::buffer_limit   = size_t(1) << 24;
+
+// The background thread that writes buffered output to file, and the
+// files with buffered output. These are never destroyed, so that they
+// remain valid whilst static output files are closed at exit.
+struct output_writer
+{
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable flushed;
+    std::vector<output_file*> files;
+    std::thread* thread = nullptr;
+    bool stopping = false;
+    std::terminate_handler on_terminate = nullptr;
+};
+
+static output_writer& writer()
+{
+    static output_writer* w = new output_writer();
+    return *w;
+}
+
+static void flush_then_terminate()
+{
+    // Write out what we can before terminating (e.g. on an
+    // uncaught exception), then carry on as we would have
+    output_file::flush_all();
+    if (writer().on_terminate) writer().on_terminate();
+    abort();
+}
+
+void output_file :: writer_loop()
+{
+    // Periodically write out the buffers of all registered files.
+    // The registry is only locked whilst taking a copy of it, so
+    // that output can carry on whilst the files are written; a
+    // file being written is not closed until it's flush is done.
+    output_writer& w = writer();
+    std::unique_lock<std::mutex> lock(w.mutex);
+    while (!w.stopping)
+    {
+        auto interval = std::chrono::duration<double>(output_file::flush_interval);
+        w.wake.wait_for(lock, interval);
+
+        std::vector<output_file*> files = w.files;
+        for (output_file* f : files) f->writer_flushes += 1;
+        lock.unlock();
+
+        for (output_file* f : files)
+            f->flush();
+
+        lock.lock();
+        for (output_file* f : files) f->writer_flushes -= 1;
+        w.flushed.notify_all();
+    }
+}
+
+void output_file :: written(size_t buffered)
+{
+    // Called after output is added to the buffer. Register this
+    // file with the background writer if it isn't already.
+    if (!registered)
+    {
+        output_writer& w = writer();
+        std::lock_guard<std::mutex> lock(w.mutex);
+        if (registered) return written(buffered);
+        w.files.push_back(this);
+        registered = true;
+        if (w.thread == nullptr)
+        {
+            if (w.on_terminate == nullptr)
+                w.on_terminate = std::set_terminate(flush_then_terminate);
+            w.stopping = false;
+            w.thread   = new std::thread(writer_loop);
+        }
+    }
+
+    if (auto_flush || buffered > 4*buffer_limit) flush();
+    else if (buffered > buffer_limit) writer().wake.notify_one();
+}
+
+void output_file :: write(const void* data, size_t size)
+{
+    size_t buffered;
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex);
+        buffer.write((const char*)data, size);
+        buffered = buffer.tellp();
+    }
+    written(buffered);
+}
+
+void output_file :: flush()
+{
+    // Write the buffer to the file now
+    std::lock_guard<std::mutex> file_lock(file_mutex);
+    std::string pending;
+    {
+        std::lock_guard<std::mutex> lock(buffer_mutex);
+        pending = buffer.str();
+        buffer.str("");
+        flushed += pending.size();
+    }
+    if (pending.empty()) return;
+
+    if (!file.is_open())
+    {
+        auto mode = append ? std::ofstream::app : std::ofstream::trunc;
+        file.open(filename, mode | std::ofstream::binary);
+    }
+    file.write(pending.data(), pending.size());
+    file.flush();
+}
+
+void output_file :: close()
+{
+    // Stop the background writer from writing this file (stopping
+    // the writer itself if this is the last file) and then
+    // write out the remaining buffer
+    if (registered)
+    {
+        output_writer& w = writer();
+        std::thread* to_join = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(w.mutex);
+            w.files.erase(std::remove(w.files.begin(), w.files.end(), this), w.files.end());
+            registered = false;
+            w.flushed.wait(lock, [this]{ return writer_flushes == 0; });
+            if (w.files.empty())
+            {
+                to_join    = w.thread;
+                w.thread   = nullptr;
+                w.stopping = true;
+            }
+        }
+        if (to_join != nullptr)
+        {
+            w.wake.notify_one();
+            to_join->join();
+            delete to_join;
+        }
+    }
+
+    flush();
+    if (file.is_open()) file.close();
+}
+
+uint64_t output_file :: size()
+{
+    std::lock_guard<std::mutex> lock(buffer_mutex);
+    return flushed + uint64_t(buffer.tellp());
+}
+
+void output_file :: truncate(uint64_t size)
+{
+    std::lock_guard<std::mutex> file_lock(file_mutex);
+    std::lock_guard<std::mutex> lock(buffer_mutex);
+    buffer.str("");
+    if (file.is_open()) file.close();
+
+    // (never extend the file, if it is shorter)
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) size = 0;
+    else if (uint64_t(info.st_size) < size) size = info.st_size;
+    else ::truncate(filename.c_str(), size);
+
+    flushed = size;
+    append  = true;
+}
+
+void output_file :: flush_all()
+{
+    // Write out the buffers of all registered files (if the
+    // registry is in use, e.g. this is called from within the
+    // background writer, we flush what we can without it)
+    output_writer& w = writer();
+    std::unique_lock<std::mutex> lock(w.mutex, std::try_to_lock);
+    for (output_file* f : w.files)
+        f->flush();
+}
+
+TEST_CASE("Output file tests", "[output_file]")
+{
+    std::string filename = "test_output_" + std::to_string(params::pid);
+    auto contents = [&filename]()
+    {
+        std::ifstream in(filename, std::ifstream::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    };
+
+    SECTION("Buffered output")
+    {
+        // Output appears in the file once flushed
+        output_file f(filename);
+        f << "Iteration " << 1 << " " << 0.5 << "\n";
+        double x[2] = {1.0, 2.0};
+        f.write(x, sizeof(x));
+        f.flush();
+
+        std::string expected = "Iteration 1 0.5\n" + std::string((char*)x, sizeof(x));
+        REQUIRE(contents() == expected);
+
+        // ...and by the background writer
+        double interval = output_file::flush_interval;
+        output_file::flush_interval = 0.01;
+        f << "more";
+        for (unsigned i=0; i<200 && contents() != expected + "more"; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        REQUIRE(contents() == expected + "more");
+        output_file::flush_interval = interval;
+    }
+
+    SECTION("Close and append")
+    {
+        // Closing writes everything, appending continues the file
+        {
+            output_file f(filename);
+            for (unsigned i=0; i<1000; ++i) f << i << ",";
+        }
+        output_file f(filename);
+        f.append = true;
+        f << "end";
+        f.close();
+
+        std::string expected;
+        for (unsigned i=0; i<1000; ++i) expected += std::to_string(i) + ",";
+        REQUIRE(contents() == expected + "end");
+    }
+
+    SECTION("Truncation")
+    {
+        // Truncating discards later output, and the size
+        // counts output whether or not it is written yet
+        output_file f(filename);
+        f << "0123456789";
+        f.flush();
+        f << "abc";
+        REQUIRE(f.size() == 13);
+        f.truncate(4);
+        REQUIRE(f.size() == 4);
+        f << "xy";
+        f.close();
+        REQUIRE(contents() == "0123xy");
+    }
+
+    std::remove(filename.c_str());
+}
@@ -16,38 +16,93 @@
     For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
 
 */
-
 #ifndef __OUTPUT_FILE__
 #define __OUTPUT_FILE__
 
-// Class to help with I/O. Leaves the file
-// closed until it's needed.
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+// Class to help with I/O. Leaves the file closed until it's
+// needed. Output is collected in memory and written to the file
+// by a background thread (shared by all output files) at most
+// flush_interval seconds later, or sooner if a lot of output
+// builds up, so that the caller never waits on the filesystem.
+// flush() and close() write out the buffer immediately, as does
+// an uncaught exception or the end of the program.
 class output_file
 {
 public:
     output_file() { filename = "/dev/null"; }
     output_file(std::string fn) { filename = fn; }
+    ~output_file() { close(); }
 
     template<class T>
     output_file& operator<<(T t)
     {
-        if (!file.is_open()) file.open(filename, std::ofstream::trunc);
-        file << t;
-        if (auto_flush) flush();
+        size_t size;
+        {
+            std::lock_guard<std::mutex> lock(buffer_mutex);
+            buffer << t;
+            size = buffer.tellp();
+        }
+        written(size);
         return (*this);
     }
 
+    // Write size bytes from data, unformatted
+    void write(const void* data, size_t size);
+
     void open(std::string fn) { filename = fn; }
-    void close() { if(file.is_open()) file.close(); }
-    void flush() { if(file.is_open()) file.flush(); }
+    void close();
+    void flush();
+
+    // The size of the file, including output not yet written to it
+    uint64_t size();
 
-    // Set to true to automatically flush the file after each write
+    // Cut the file back to the given size (if it is longer), discarding
+    // any buffered output, and continue by appending to it
+    void truncate(uint64_t size);
+
+    // Set to true to write to the file after each write
     bool auto_flush = false;
 
+    // Set to true to append to, rather than overwrite, the file
+    bool append = false;
+
+    // The longest time (in seconds) that output is
+    // buffered before being written to the file
+    static double flush_interval;
+
+    // The buffered output (in bytes) at which the background
+    // thread is woken early, and (x4) at which output is
+    // written by the caller, rather than buffering any more
+    static size_t buffer_limit;
+
+    // Write out the buffers of all output files
+    static void flush_all();
+
 private:
+    void written(size_t buffered);
+    static void writer_loop();
+
     std::string filename;
     std::ofstream file;
+    std::ostringstream buffer;
+    uint64_t flushed = 0;
+
+    // Held whilst accessing the buffer, and whilst
+    // writing the buffer to the file, respectively
+    std::mutex buffer_mutex;
+    std::mutex file_mutex;
+    std::atomic<bool> registered{false};
+
+    // The number of flushes of this file by the background
+    // writer in progress (guarded by the writer's mutex)
+    unsigned writer_flushes = 0;
 };
 
 #endif
-
@@ -103,37 +103,29 @@ void particle :: exchange(particle* other)
     }
 }
 
-double particle :: sq_distance_to(particle* other)
+double particle :: sq_distance(double* x, double* y)
 {
     // Unpacking for speed
-    // (about twice as fast by my tests)
-    if (params::dimensions == 1)
-    {
-        double dx = this->coords[0] - other->coords[0];
-        return dx*dx;
-    }
-    else if (params::dimensions == 2)
-    {
-        double dx0 = this->coords[0] - other->coords[0];
-        double dx1 = this->coords[1] - other->coords[1];
-        return dx0*dx0 + dx1*dx1;
-    }
-    else if (params::dimensions == 3)
-    {
-        double dx0 = this->coords[0] - other->coords[0];
-        double dx1 = this->coords[1] - other->coords[1];
-        double dx2 = this->coords[2] - other->coords[2];
-        return dx0*dx0 + dx1*dx1 + dx2*dx2;
-    }
+    unsigned d = params::dimensions;
+    if (d == 1) return ::sq_distance<1>(x, y, d);
+    if (d == 2) return ::sq_distance<2>(x, y, d);
+    if (d == 3) return ::sq_distance<3>(x, y, d);
+    return ::sq_distance<0>(x, y, d);
+}
+
+double particle :: sq_norm(double* x)
+{
+    unsigned d = params::dimensions;
+    if (d == 1) return ::sq_norm<1>(x, d);
+    if (d == 2) return ::sq_norm<2>(x, d);
+    if (d == 3) return ::sq_norm<3>(x, d);
+    return ::sq_norm<0>(x, d);
+}
 
+double particle :: sq_distance_to(particle* other)
+{
     // Returns | this->coords - other->coords |^2
-    double r2 = 0;
-    for (unsigned i=0; i<params::dimensions; ++i)
-    {
-        double dxi = this->coords[i] - other->coords[i];
-        r2 += dxi * dxi;
-    }
-    return r2;
+    return sq_distance(this->coords, other->coords);
 }
 
 double particle::interaction(particle* other)
@@ -145,13 +137,21 @@ double particle::interaction(particle* other)
     return coulomb(this->charge, other->charge, r);
 }
 
+double particle::interaction(particle* other, double r)
+{
+    if (fabs(this->charge)  < 10e-10) return 0;
+    if (fabs(other->charge) < 10e-10) return 0;
+    return coulomb(this->charge, other->charge, r);
+}
+
 void particle :: diffuse(double tau)
 {
     // Diffuse the particle by moving each
     // coordinate by an amount sampled from
     // a normal distribution with variance tau/mass.
+    double var = tau/this->mass;
     for (unsigned i=0; i<params::dimensions; ++i)
-        this->coords[i] += rand_normal(tau/this->mass);
+        this->coords[i] += rand_normal(var);
 }
 
 void particle :: sample_wavefunction()
@@ -34,6 +34,7 @@ public:
 
     double sq_distance_to(particle* other); // Returns | this->coords - other->coords |^2
     double interaction(particle* other);    // The interaction energy with some other particle
+    double interaction(particle* other, double r); // As above, at a seperation r
     int exchange_symmetry(particle* other); // 1, 0 or -1 depending on spin statistics
     void exchange(particle* other);         // Swap my coordinates with those of other
 
@@ -50,6 +51,12 @@ public:
 
     // The location of this particle
     double* coords;
+
+    // Returns | x - y |^2 for two particle positions x and y, and
+    // |x|^2 for a particle position x (hot loops should instead use
+    // the versions in dmc_math.h specialised on the dimensions).
+    static double sq_distance(double* x, double* y);
+    static double sq_norm(double* x);
 };
 
 #endif
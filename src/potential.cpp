@@ -68,7 +68,7 @@ grid_potential :: grid_potential(std::string filename)
     }
 }
 
-double grid_potential :: potential(particle* p)
+double grid_potential :: potential(particle* p, double* x)
 {
     int coord = 0;
     int stride = 1;
@@ -76,7 +76,7 @@ double grid_potential :: potential(particle* p)
     for (unsigned i=0; i<params::dimensions; ++i)
     {
         // Work out the coordinate I'm at
-        double frac = (p->coords[i] + extent)/(2*extent);
+        double frac = (x[i] + extent)/(2*extent);
         int c = int(grid_size*frac);
         
         // Outside of grid => infinite potential
@@ -98,11 +98,9 @@ std::string harmonic_well :: one_line_description()
     return des.str();
 }
 
-double harmonic_well::potential(particle* p)
+double harmonic_well::potential(particle* p, double* x)
 {
-    double r2 = 0;
-    for (unsigned i=0; i<params::dimensions; ++i)
-        r2 += p->coords[i]*p->coords[i];
+    double r2 = particle::sq_norm(x);
     return 0.5*r2*omega*omega;
 }
 
@@ -115,15 +113,9 @@ std::string atomic_potential :: one_line_description()
     return des.str();
 }
 
-double atomic_potential :: potential(particle* p)
+double atomic_potential :: potential(particle* p, double* x)
 {
-    double r = 0;
-    for (unsigned i=0; i<params::dimensions; ++i)
-    {
-        double dxi = p->coords[i] - this->coords[i];
-        r += dxi * dxi;
-    }
-    r = sqrt(r);
+    double r = sqrt(particle::sq_distance(x, this->coords));
     return coulomb(this->charge, p->charge, r);
 }
 
@@ -26,7 +26,9 @@
 class external_potential
 {
 public:
-    virtual double potential(particle* p)=0;
+    // The potential felt by the particle p at the position x
+    virtual double potential(particle* p, double* x)=0;
+    double potential(particle* p) { return potential(p, p->coords); }
     virtual std::string one_line_description()=0;
     virtual ~external_potential() { }
 };
@@ -35,7 +37,8 @@ class grid_potential : public external_potential
 {
 public:
     grid_potential(std::string filename);
-    virtual double potential(particle* p);
+    using external_potential::potential;
+    virtual double potential(particle* p, double* x);
     virtual std::string one_line_description();
     virtual ~grid_potential() { delete[] this->data; }
 private:
@@ -48,7 +51,8 @@ class harmonic_well : public external_potential
 {
 public:
     harmonic_well(double omega) { this->omega = omega; }
-    virtual double potential(particle* p);
+    using external_potential::potential;
+    virtual double potential(particle* p, double* x);
     virtual std::string one_line_description();
 private:
     double omega = 1;
@@ -68,7 +72,8 @@ public:
         delete[] this->coords;
     }
 
-    virtual double potential(particle* p);
+    using external_potential::potential;
+    virtual double potential(particle* p, double* x);
     virtual std::string one_line_description();
 private:
     double  charge;
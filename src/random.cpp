@@ -0,0 +1,190 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+
+#include "catch.h"
+#include "random.h"
+
+#include <set>
+#include <vector>
+
+// Each thread has it's own stream (seeded, by default,
+// as stream 0 of seed 0 until seed_random is called)
+thread_local random_stream rng;
+
+void philox4x32(const uint32_t* ctr, const uint32_t* key, uint32_t* out)
+{
+    philox4x32_inline(ctr, key, out);
+}
+
+void random_stream :: seed(uint64_t seed, uint64_t stream)
+{
+    // Start at block 0 of the given stream
+    key[0] = uint32_t(seed);
+    key[1] = uint32_t(seed >> 32);
+    ctr[0] = 0;
+    ctr[1] = 0;
+    ctr[2] = uint32_t(stream);
+    ctr[3] = uint32_t(stream >> 32);
+    available = 0;
+}
+
+void random_stream :: fill_uniform(double* u, unsigned n)
+{
+    // Fill u with n uniform random numbers \in (0,1). Whole blocks
+    // are generated from consecutive counters, so the loop over
+    // blocks has no dependencies and can be vectorized.
+    const double scale = 1.0 / 9007199254740992.0;
+    unsigned blocks = n / 2;
+    for (unsigned b=0; b<blocks; ++b)
+    {
+        uint32_t c[4] = {ctr[0] + b, ctr[1], ctr[2], ctr[3]};
+        if (c[0] < ctr[0]) ++c[1];
+        uint32_t out[4];
+        philox4x32_inline(c, key, out);
+        u[2*b]   = ((uint64_t(out[0] >> 5) << 26 | (out[1] >> 6)) + 0.5) * scale;
+        u[2*b+1] = ((uint64_t(out[2] >> 5) << 26 | (out[3] >> 6)) + 0.5) * scale;
+    }
+
+    // Advance the counter past the blocks used
+    uint32_t old = ctr[0];
+    ctr[0] += blocks;
+    if (ctr[0] < old) ++ctr[1];
+
+    // Odd remainder
+    if (n % 2 == 1) u[n-1] = rand_uniform();
+}
+
+void rand_normal(double* x, unsigned n)
+{
+    // Fill x with n standard normal numbers using a Box-Muller
+    // transform that keeps both outputs, so each pair of normals
+    // costs one log, one sqrt and one sincos. The uniforms are
+    // generated in a single batch first, leaving a transform loop
+    // with no dependencies between iterations.
+    unsigned pairs = (n + 1) / 2;
+    static thread_local std::vector<double> u;
+    if (u.size() < 2*pairs) u.resize(2*pairs);
+    rng.fill_uniform(&u[0], 2*pairs);
+
+    for (unsigned i=0; i<n/2; ++i)
+    {
+        double r = sqrt(-2*log(u[2*i]));
+        double t = 2*PI*u[2*i+1];
+        x[2*i]   = r * cos(t);
+        x[2*i+1] = r * sin(t);
+    }
+
+    // Odd remainder, only one output is needed
+    if (n % 2 == 1)
+        x[n-1] = sqrt(-2*log(u[n-1])) * sin(2*PI*u[n]);
+}
+
+void seed_random(uint64_t seed, uint64_t stream)
+{
+    rng.seed(seed, stream);
+}
+
+TEST_CASE("Random number tests", "[random]")
+{
+    // Known-answer tests for Philox4x32-10 (from Random123)
+    uint32_t ctr[4] = {0, 0, 0, 0};
+    uint32_t key[2] = {0, 0};
+    uint32_t out[4];
+    philox4x32(ctr, key, out);
+    REQUIRE(out[0] == 0x6627e8d5u);
+    REQUIRE(out[1] == 0xe169c58du);
+    REQUIRE(out[2] == 0xbc57ac4cu);
+    REQUIRE(out[3] == 0x9b00dbd8u);
+
+    uint32_t ctr_max[4] = {0xffffffffu, 0xffffffffu, 0xffffffffu, 0xffffffffu};
+    uint32_t key_max[2] = {0xffffffffu, 0xffffffffu};
+    philox4x32(ctr_max, key_max, out);
+    REQUIRE(out[0] == 0x408f276du);
+    REQUIRE(out[1] == 0x41c83b0eu);
+    REQUIRE(out[2] == 0xa20bc7c6u);
+    REQUIRE(out[3] == 0x6d5451fdu);
+
+    // Streams are reproducible and distinct
+    random_stream saved = rng;
+    double first[8], again[8], other[8];
+    seed_random(1234, 0);
+    for (unsigned i=0; i<8; ++i) first[i] = rand_uniform();
+    seed_random(1234, 0);
+    for (unsigned i=0; i<8; ++i) again[i] = rand_uniform();
+    seed_random(1234, 1);
+    for (unsigned i=0; i<8; ++i) other[i] = rand_uniform();
+    for (unsigned i=0; i<8; ++i)
+    {
+        REQUIRE(first[i] == again[i]);
+        REQUIRE(first[i] != other[i]);
+    }
+
+    // Uniform numbers lie strictly in (0,1) and
+    // have the right mean and variance
+    const unsigned n = 100000;
+    double mean = 0;
+    double var  = 0;
+    unsigned out_of_range = 0;
+    std::vector<double> u(n);
+    rng.fill_uniform(&u[0], n);
+    for (unsigned i=0; i<n; ++i)
+    {
+        if (u[i] <= 0 || u[i] >= 1) ++out_of_range;
+        mean += u[i]/n;
+        var  += (u[i] - 0.5)*(u[i] - 0.5)/n;
+    }
+    REQUIRE(out_of_range == 0);
+    REQUIRE(fabs(mean - 0.5) < 0.01);
+    REQUIRE(fabs(var - 1.0/12) < 0.01);
+
+    // Normal numbers have the right variance
+    var = 0;
+    for (unsigned i=0; i<n; ++i)
+    {
+        double x = rand_normal(2.0);
+        var += x*x/n;
+    }
+    REQUIRE(fabs(var - 2.0) < 0.05);
+
+    // As should batches of normal numbers (of odd length, to
+    // check the remainder), with mean zero, unit variance and
+    // the pairs from each transform uncorrelated
+    std::vector<double> z(n+1);
+    rand_normal(&z[0], n+1);
+    mean = var = 0;
+    double corr = 0;
+    for (unsigned i=0; i<n; ++i)
+    {
+        mean += z[i]/n;
+        var  += z[i]*z[i]/n;
+        if (i % 2 == 0) corr += z[i]*z[i+1]/(n/2);
+    }
+    REQUIRE(fabs(mean) < 0.02);
+    REQUIRE(fabs(var - 1.0) < 0.03);
+    REQUIRE(fabs(corr) < 0.03);
+
+    // Random integers cover their range
+    std::set<unsigned> ints;
+    for (unsigned i=0; i<1000; ++i)
+        ints.insert(rand_int(7));
+    REQUIRE(ints.size() == 7);
+    REQUIRE(*ints.rbegin() == 6);
+
+    rng = saved;
+}
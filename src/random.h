@@ -21,14 +21,103 @@
 #define __RANDOM__
 
 #include <math.h>
+#include <stdint.h>
 #include "constants.h"
 
-// Generate a uniform random number \in [0,1].
+// Random numbers are generated by the counter-based Philox4x32-10
+// generator (Salmon et al., "Parallel random numbers: as easy as
+// 1, 2, 3", SC11). Each output block is a pure function of a
+// 128-bit counter and a 64-bit key, so there is no hidden global
+// state and independent streams are obtained simply by giving
+// each process/thread a different part of the counter space.
+//
+// The key is the seed, the upper half of the counter is the
+// stream id and the lower half counts blocks within the stream.
+void philox4x32(const uint32_t* ctr, const uint32_t* key, uint32_t* out);
+
+// The state of a single stream of random numbers
+struct random_stream
+{
+    uint32_t key[2];
+    uint32_t ctr[4];
+    uint32_t block[4];
+    unsigned available;
+
+    void seed(uint64_t seed, uint64_t stream);
+    void next_block();
+    void fill_uniform(double* u, unsigned n);
+};
+
+// The stream used by this thread
+extern thread_local random_stream rng;
+
+// Seed the stream of this thread, streams with different ids
+// are statistically independent for any given seed
+void seed_random(uint64_t seed, uint64_t stream);
+
+inline uint32_t round_multiply(uint32_t a, uint32_t b, uint32_t* hi)
+{
+    // Return the low 32 bits of a*b, set hi to the high 32 bits
+    uint64_t p = uint64_t(a) * uint64_t(b);
+    *hi = uint32_t(p >> 32);
+    return uint32_t(p);
+}
+
+inline void philox4x32_inline(const uint32_t* ctr, const uint32_t* key, uint32_t* out)
+{
+    // The Philox4x32 bijection with 10 rounds, written
+    // without branches so that it can be inlined and
+    // vectorized across independent counters
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    for (unsigned r=0; r<10; ++r)
+    {
+        uint32_t hi0, hi1;
+        uint32_t lo0 = round_multiply(0xD2511F53u, c0, &hi0);
+        uint32_t lo1 = round_multiply(0xCD9E8D57u, c2, &hi1);
+        c0 = hi1 ^ c1 ^ k0;
+        c1 = lo1;
+        c2 = hi0 ^ c3 ^ k1;
+        c3 = lo0;
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+inline void random_stream :: next_block()
+{
+    // Generate the next block of four outputs
+    philox4x32_inline(ctr, key, block);
+    if (++ctr[0] == 0) ++ctr[1];
+    available = 4;
+}
+
+// Generate a uniformly distributed 32-bit integer
+inline uint32_t rand_u32()
+{
+    if (rng.available == 0) rng.next_block();
+    return rng.block[--rng.available];
+}
+
+// Generate a uniform random number \in (0,1), from 53 random
+// bits. Neither 0 nor 1 can be returned, so log(u) is safe.
 inline double rand_uniform()
 {
-    return (rand()%RAND_MAX)/double(RAND_MAX);
+    uint64_t hi = rand_u32() >> 5;
+    uint64_t lo = rand_u32() >> 6;
+    return ((hi << 26 | lo) + 0.5) * (1.0 / 9007199254740992.0);
 }
 
+// Generate a random integer \in [0, n)
+inline unsigned rand_int(unsigned n)
+{
+    return unsigned((uint64_t(rand_u32()) * n) >> 32);
+}
+
+// Fill x with n standard normally distributed numbers
+void rand_normal(double* x, unsigned n);
+
 // Generate a zero-mean noramlly distributed number
 // with the specified variance using a Box-Muller transform.
 inline double rand_normal(double var)
@@ -39,16 +128,3 @@ inline double rand_normal(double var)
 }
 
 #endif
-
-
-
-
-
-
-
-
-
-
-
-
-
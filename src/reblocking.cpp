@@ -0,0 +1,203 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#include <cmath>
+
+#include "catch.h"
+#include "random.h"
+#include "reblocking.h"
+
+void reblocking :: add(double x)
+{
+    // Add x to the first level, passing the mean of each
+    // completed pair of blocks up to the next level
+    for (unsigned k=0; ; ++k)
+    {
+        if (k == levels.size()) levels.emplace_back();
+        level& l = levels[k];
+
+        // Welford update of the mean/variance
+        l.count += 1;
+        double delta = x - l.mean;
+        l.mean += delta / l.count;
+        l.m2   += delta * (x - l.mean);
+
+        if (!l.has_pending)
+        {
+            l.pending     = x;
+            l.has_pending = true;
+            return;
+        }
+
+        x = (l.pending + x) / 2.0;
+        l.has_pending = false;
+    }
+}
+
+double reblocking :: error(unsigned k)
+{
+    // The standard error of the mean, treating
+    // blocks of size 2^k as independent
+    if (k >= levels.size() || levels[k].count < 2) return 0;
+    double n = levels[k].count;
+    return sqrt(levels[k].m2 / (n * (n - 1)));
+}
+
+unsigned reblocking :: optimal_level(bool* satisfied)
+{
+    // The smallest block size satisfying the criterion above (with
+    // enough blocks for a sensible error estimate) or, if there is
+    // none, that with the largest error estimated from a few blocks
+    if (satisfied) *satisfied = false;
+    if (count() < 2) return 0;
+    double n  = count();
+    double e1 = error(0);
+
+    for (unsigned k=0; k<levels.size() && levels[k].count >= min_blocks; ++k)
+    {
+        double b = pow(2.0, k);
+        if (e1 == 0 || b*b*b > 2 * n * pow(error(k)/e1, 4))
+        {
+            if (satisfied) *satisfied = true;
+            return k;
+        }
+    }
+
+    unsigned largest = 0;
+    for (unsigned k=0; k<levels.size() && levels[k].count >= 4; ++k)
+        if (error(k) > error(largest))
+            largest = k;
+    return largest;
+}
+
+bool reblocking :: converged()
+{
+    // True if the criterion is satisfied by some block size
+    bool satisfied;
+    optimal_level(&satisfied);
+    return satisfied;
+}
+
+double reblocking :: correlation_time()
+{
+    // The ratio of the variance of the mean to that
+    // expected if the values were uncorrelated
+    double e1 = error(0);
+    if (e1 == 0) return 1;
+    double ratio = error() / e1;
+    return ratio * ratio;
+}
+
+void reblocking :: save_state(std::vector<double>& state)
+{
+    // Stored as the number of levels, followed
+    // by the five values of each level
+    state.push_back(levels.size());
+    for (const level& l : levels)
+    {
+        state.push_back(l.count);
+        state.push_back(l.mean);
+        state.push_back(l.m2);
+        state.push_back(l.pending);
+        state.push_back(l.has_pending);
+    }
+}
+
+void reblocking :: load_state(const std::vector<double>& state, unsigned& position)
+{
+    levels.clear();
+    if (position >= state.size()) return;
+    unsigned count = state[position++];
+    if (position + 5*count > state.size())
+        throw "Reblocking state is incomplete!";
+
+    levels.resize(count);
+    for (level& l : levels)
+    {
+        l.count       = state[position++];
+        l.mean        = state[position++];
+        l.m2          = state[position++];
+        l.pending     = state[position++];
+        l.has_pending = state[position++] != 0.0;
+    }
+}
+
+TEST_CASE("Reblocking tests", "[reblocking]")
+{
+    const unsigned n = 1 << 14;
+
+    SECTION("Uncorrelated values")
+    {
+        reblocking r;
+        for (unsigned i=0; i<n; ++i)
+            r.add(1.0 + rand_normal(1.0));
+
+        REQUIRE(r.count() == n);
+        REQUIRE(r.level_count() == 15);
+        REQUIRE(r.converged());
+        REQUIRE(fabs(r.mean() - 1.0) < 5.0/sqrt(n));
+        REQUIRE(fabs(r.error() * sqrt(n) - 1.0) < 0.2);
+        REQUIRE(r.correlation_time() < 1.5);
+    }
+
+    SECTION("Saving and loading state")
+    {
+        // Continuing from loaded state should be
+        // the same as never having stopped
+        reblocking r, r_loaded;
+        for (unsigned i=0; i<1000; ++i)
+            r.add(rand_normal(1.0));
+
+        std::vector<double> state = {7.0};
+        r.save_state(state);
+        unsigned position = 1;
+        r_loaded.load_state(state, position);
+        REQUIRE(position == state.size());
+
+        for (unsigned i=0; i<1001; ++i)
+        {
+            double x = rand_normal(1.0);
+            r.add(x);
+            r_loaded.add(x);
+        }
+        REQUIRE(r_loaded.count() == r.count());
+        REQUIRE(r_loaded.level_count() == r.level_count());
+        REQUIRE(r_loaded.mean() == r.mean());
+        REQUIRE(r_loaded.error() == r.error());
+    }
+
+    SECTION("Correlated values")
+    {
+        // An AR(1) series x_i = phi x_{i-1} + noise, for which
+        // correlations reduce the number of independent values
+        // by (1 + phi)/(1 - phi) = 19
+        reblocking r;
+        double phi = 0.9;
+        double x   = 0;
+        for (unsigned i=0; i<n; ++i)
+        {
+            x = phi * x + rand_normal(1.0);
+            r.add(x);
+        }
+
+        REQUIRE(r.converged());
+        REQUIRE(r.correlation_time() > 10.0);
+        REQUIRE(r.correlation_time() < 40.0);
+        REQUIRE(r.error() > 3 * r.error(0));
+    }
+}
@@ -0,0 +1,80 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#ifndef __REBLOCKING__
+#define __REBLOCKING__
+
+#include <vector>
+
+// Online Flyvbjerg-Petersen reblocking of a serially correlated
+// series of values (e.g the energy at each DMC iteration). Level k
+// accumulates the means of consecutive blocks of 2^k values, so
+// that only O(log n) memory is needed for n values. The standard
+// error of the mean is taken from the smallest block size, B,
+// satisfying B^3 > 2n(e_B/e_1)^4 (where e_B is the standard error
+// estimated from blocks of size B), as suggested by Lee et al.
+// Phys. Rev. E 83, 066706 (2011).
+class reblocking
+{
+public:
+    void add(double x);
+
+    unsigned count() { return levels.empty() ? 0 : levels[0].count; }
+    double mean()    { return levels.empty() ? 0 : levels[0].mean; }
+
+    // The standard error of the mean, and the correlation time
+    // (the factor by which correlations reduce the number of
+    // independent values) estimated from the optimal block size
+    double error()            { return error(optimal_level()); }
+    double correlation_time();
+
+    // False if no block size satisfies the above criterion yet,
+    // in which case the error is estimated conservatively
+    bool converged();
+
+    // The standard error estimated from blocks of size 2^k
+    double error(unsigned k);
+    unsigned level_count() { return levels.size(); }
+
+    // Append the levels to state, or restore them from state
+    // (starting at, and advancing, position) e.g for checkpointing
+    void save_state(std::vector<double>& state);
+    void load_state(const std::vector<double>& state, unsigned& position);
+
+private:
+    unsigned optimal_level(bool* satisfied = nullptr);
+
+    // The fewest blocks from which the error is taken
+    // to satisfy the criterion
+    static const unsigned min_blocks = 16;
+
+    // The number, mean and sum of squared deviations of the
+    // blocks at each level, and the first half of the next block
+    // to be passed up a level (if has_pending)
+    struct level
+    {
+        unsigned long count = 0;
+        double mean         = 0;
+        double m2           = 0;
+        double pending      = 0;
+        bool has_pending    = false;
+    };
+    std::vector<level> levels;
+};
+
+#endif
@@ -14,7 +14,7 @@
 # 
 #     For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
 # 
-from parser import call_on_walkers
+from parser import call_on_walkers, wavefunction_shape
 import numpy as np
 import sys
 
@@ -133,11 +133,7 @@ def normalized(d, norm):
     if abs(n) < 10e-6: return d
     return norm*d/n
 
-with open("wavefunction_0") as f:
-    for line in f:
-        if "#" in line: continue
-        particle_count = len(line.split(";"))
-        break
+particle_count = wavefunction_shape("wavefunction_0")[0]
 
 density      = normalized(density**2,      particle_count)
 cond_density = normalized(cond_density**2, particle_count-1)
@@ -17,6 +17,7 @@
 import numpy as np
 import sys
 import os
+from parser import call_on_walkers_single, wavefunction_shape
 
 # The fixed coordinates that we plot the wavefunction for
 read_fixed = {}
@@ -38,11 +39,7 @@ def attenuation(x,y):
     return np.exp(-r2)
 
 # Count the number of particles
-with open("wavefunction_0") as f:
-    for line in f:
-        if "#" in line: continue
-        particle_count = len(line.split(";"))
-        break
+particle_count = wavefunction_shape("wavefunction_0")[0]
 
 # Get the fixed positions for the other particles
 for i in range(1, particle_count):
@@ -55,6 +52,35 @@ RES        = 100
 SCALE      = 4.0
 bins       = np.zeros((RES, RES))
 
+def skip(iteration):
+    return iteration < start_iter or iteration > end_iter
+
+def bin_walker(iteration, w, xs):
+    global datapoints, eff_datapoints
+
+    # The attenuation
+    att = 1
+
+    # Fix other coordinates of first particle to 0
+    for j in range(2, len(xs[0])):
+        att *= attenuation([xs[0][j]],[0])
+
+    # Fix other particles to their fixed locations
+    for j in range(1, len(xs)):
+        xj   = xs[j]
+        att *= attenuation(xj, fixed(j))
+
+    # Bin this x, y point
+    xi = int(RES*(xs[0][0] + SCALE) / (2*SCALE))
+    yi = int(RES*(xs[0][1] + SCALE) / (2*SCALE))
+
+    try:
+        bins[xi][yi]   += w * att
+        datapoints     += 1
+        eff_datapoints += att
+    except IndexError:
+        return
+
 # Loop over wavefunction files
 datapoints     = 0
 eff_datapoints = 0
@@ -67,50 +93,7 @@ while True:
         break
 
     print("Reading "+filename)
-    with open(filename) as f:
-
-        iteration = 0
-
-        # Loop over lines in wfn file
-        for line in f:
-
-            # We've reached a new iteration
-            if line.startswith("#"):
-                iteration += 1
-                if iteration % 1000 == 0:
-                    print("    Iteration {0}".format(iteration))
-                continue
-
-            if iteration < start_iter: continue
-            if iteration > end_iter  : break
-
-            # Parse the coordinates from this line
-            w, coords = line.split(":")
-            w = float(w)
-            xs = [[float(x) for x in c.split(",")] for c in coords.split(";")]
-
-            # The attenuation
-            att = 1
-
-            # Fix other coordinates of first particle to 0
-            for j in range(2, len(xs[0])):
-                att *= attenuation([xs[0][j]],[0])
-
-            # Fix other particles to their fixed locations
-            for j in range(1, len(xs)):
-                xj   = xs[j]
-                att *= attenuation(xj, fixed(j))
-
-            # Bin this x, y point
-            xi = int(RES*(xs[0][0] + SCALE) / (2*SCALE))
-            yi = int(RES*(xs[0][1] + SCALE) / (2*SCALE))
-
-            try:
-                bins[xi][yi]   += w * att
-                datapoints     += 1
-                eff_datapoints += att
-            except IndexError:
-                continue
+    call_on_walkers_single(bin_walker, skip, filename)
 
 print("Datapoints          : {0}".format(datapoints))
 print("Effective datapoints: {0} ({1} %)".format(eff_datapoints, 100.0*eff_datapoints/datapoints))
@@ -19,6 +19,74 @@ import numpy as np
 import sys
 import os
 
+# The layout of binary wavefunction files (see wavefunction_format
+# and walker_collection::write_wavefunction)
+BINARY_WFN_MAGIC = b"XDMCWFN1"
+BINARY_WFN_HEADER = np.dtype([
+    ("magic",          "S8"),
+    ("dimensions",     "<u4"),
+    ("particle_count", "<u4"),
+    ("value_size",     "<u4"),
+    ("reserved",       "<u4")])
+BINARY_WFN_PARTICLE = np.dtype([
+    ("name",       "S32"),
+    ("mass",       "<f8"),
+    ("charge",     "<f8"),
+    ("half_spins", "<i4"),
+    ("reserved",   "<i4")])
+
+def is_binary_wavefunction(filename):
+    # True if filename is a binary wavefunction file
+    with open(filename, "rb") as f:
+        return f.read(len(BINARY_WFN_MAGIC)) == BINARY_WFN_MAGIC
+
+def read_binary_wavefunction(filename):
+    # Memory-map a binary wavefunction file, returning
+    # [particles, blocks] where particles is the array of
+    # particle descriptions from the header and blocks
+    # is a list of (i, w, x) for each iteration written,
+    # where i is the iteration, w is the array of walker
+    # weights and x is the array of walker configurations,
+    # indexed as x[walker][particle][dimension]. The arrays
+    # are views of the file, so are only read when used.
+    data   = np.memmap(filename, dtype=np.uint8, mode="r")
+    header = np.frombuffer(data, dtype=BINARY_WFN_HEADER, count=1)[0]
+    if header["magic"] != BINARY_WFN_MAGIC:
+        raise Exception("Error: "+filename+" is not a binary wavefunction file!")
+
+    pc = int(header["particle_count"])
+    d  = int(header["dimensions"])
+    vs = int(header["value_size"])
+    vt = np.dtype("<f4") if vs == 4 else np.dtype("<f8")
+    offset    = BINARY_WFN_HEADER.itemsize
+    particles = np.frombuffer(data, dtype=BINARY_WFN_PARTICLE, count=pc, offset=offset)
+    offset   += pc * BINARY_WFN_PARTICLE.itemsize
+
+    blocks = []
+    while offset + 16 <= len(data):
+        iteration, count = [int(v) for v in np.frombuffer(data, dtype="<u8", count=2, offset=offset)]
+        size = count * (pc * d + 1) * vs
+        if offset + 16 + size > len(data): break # Partially written
+        w = np.frombuffer(data, dtype=vt, count=count, offset=offset+16)
+        x = np.frombuffer(data, dtype=vt, count=count*pc*d, offset=offset+16+count*vs)
+        blocks.append((iteration, w, x.reshape((count, pc, d))))
+        offset += 16 + size + (-size) % 8
+
+    return [particles, blocks]
+
+def wavefunction_shape(filename):
+    # Returns [particle_count, spatial_dimensions]
+    # for the given wavefunction file
+    if is_binary_wavefunction(filename):
+        header = np.fromfile(filename, dtype=BINARY_WFN_HEADER, count=1)[0]
+        return [int(header["particle_count"]), int(header["dimensions"])]
+
+    with open(filename) as f:
+        for line in f:
+            if line.startswith("#"): continue
+            particles = line.split(":")[1].split(";")
+            return [len(particles), len(particles[0].split(","))]
+
 def call_on_walkers_single(func, skip_iter, filename):
     # Call the function func(i, w, x) over walkers
     # where i is the iteration, w is the weight
@@ -26,14 +94,27 @@ def call_on_walkers_single(func, skip_iter, filename):
     # x = [p1, p2, p3 ... ] and p1...pN are the
     # particle position vectors
 
+    if is_binary_wavefunction(filename):
+        for iteration, ws, xs in read_binary_wavefunction(filename)[1]:
+            if (iteration % 1000 == 0):
+                print("    Iteration {0}".format(iteration))
+            if skip_iter(iteration): continue
+            for w, x in zip(ws, xs):
+                func(iteration, w, x)
+        return
+
     # Loop over lines in the wavefunction file
     with open(filename) as f:
         iteration = 0
         skip = False
         for l in f:
             if l.startswith("#"):
-                # Got to next iteration
-                iteration += 1
+                # Got to next iteration, given on the header line as
+                # "# Iteration N" (iterations may not be consecutive
+                # if wavefunction_interval > 1)
+                words = l[1:].split()
+                if len(words) > 1 and words[0] == "Iteration": iteration = int(words[1])
+                else: iteration += 1
                 if (iteration % 1000 == 0):
                     print("    Iteration {0}".format(iteration))
 
@@ -94,12 +175,7 @@ def bin_wavefunction():
     bins    = int(input("Bins           : "))
 
     # Get the dimensionallity of the wavefunction
-    with open("wavefunction_0") as f:
-        for line in f:
-            if line.startswith("#"): continue
-            particle_count = len(line.split(";"))
-            spatial_dimensions = len(line.split(";")[0].split(","))
-            break
+    particle_count, spatial_dimensions = wavefunction_shape("wavefunction_0")
     config_dimensions = particle_count * spatial_dimensions
 
     # Initialize the wavefunction and accumulate it
@@ -119,12 +195,30 @@ def bin_wavefunction():
         "scale"        : scale,
         }
 
-def parse_evolution():
+def parse_density(filename):
+    # Parse a density accumulated during the calculation
+    # (see density_bins), returning [density, range], where
+    # density[i][j][k] is the density in the cell (i, j, k)
+    # of the grid covering [-range, range] in each dimension
+    header = {}
+    with open(filename) as f:
+        for l in f:
+            if not l.startswith("#"): break
+            key, value = l[1:].strip().rsplit(" ", 1)
+            header[key] = value
+
+    shape = [int(header["bins"])] * int(header["dimensions"])
+    return [np.loadtxt(filename).reshape(shape), float(header["range"])]
+
+def parse_evolution(filename="evolution", phase_times=False):
     
         # Read in our data from the evolution file
-        # ignoring the first line which has y axes labels on it
-        lines  = open("evolution").read().split("\n")
-        y_axes = lines[0].split(",")
+        # ignoring the first line which has y axes labels on it.
+        # The time spent in each phase of the calculation is
+        # written in trailing "... time" columns, which are
+        # only returned if phase_times is True.
+        lines  = open(filename).read().split("\n")
+        y_axes = [y.strip() for y in lines[0].split(",")]
         data   = []
         for line in lines[1:]:
                 if len(line.strip()) > 0:
@@ -135,6 +229,10 @@ def parse_evolution():
                         except Exception as e:
                             print(e)
         data = list(zip(*data))
+        if not phase_times:
+            keep   = [i for i, y in enumerate(y_axes) if not y.endswith(" time")]
+            y_axes = [y_axes[i] for i in keep]
+            data   = [data[i] for i in keep if i < len(data)]
         return [y_axes, data]
 
 def parse_wavefunction(sys_args):
@@ -223,6 +321,20 @@ def parse_wavefunction_file(filename, sys_args):
         print("Reading {0} from iteration {1} to {2} in steps of {3}".format(
                filename, iter_start, iter_end, iter_spacing))
 
+        if is_binary_wavefunction(filename):
+
+            # Select the requested blocks from the memory-mapped file
+            blocks = [(w, x) for i, w, x in read_binary_wavefunction(filename)[1]
+                      if i >= iter_start and i <= iter_end and i % iter_spacing == 0]
+            if len(blocks) == 0:
+                fs = "Error: iterations {0} to {1} out of range for wavefuction file {2}"
+                print(fs.format(iter_start, iter_end, filename))
+                quit()
+
+            ws = np.concatenate([w for w, x in blocks])
+            xs = np.concatenate([x for w, x in blocks])
+            return [list(ws)] + [list(xs[:,j,:]) for j in range(xs.shape[1])]
+
         data = []
         with open(filename) as f:
             iter_index = 0
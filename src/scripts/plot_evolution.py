@@ -43,7 +43,8 @@ for arg in sys.argv:
         break
 
 # Read in the evolution data
-y_axes, data = parse_evolution()
+# The time spent in each phase is only plotted if requested
+y_axes, data = parse_evolution(phase_times="times" in sys.argv)
 
 i_include=[]
 for a in sys.argv:
@@ -0,0 +1,45 @@
+# 
+#     XDMC
+#     Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+# 
+#     This program is free software: you can redistribute it and/or modify
+#     it under the terms of the GNU General Public License as published by
+#     the Free Software Foundation, either version 3 of the License, or
+#     (at your option) any later version.
+# 
+#     This program is distributed in the hope that it will be useful,
+#     but WITHOUT ANY WARRANTY; without even the implied warranty of
+#     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#     GNU General Public License for more details.
+# 
+#     For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+# 
+import os
+import tempfile
+from parser import parse_evolution
+
+# Tests of the output parsers, run with python3 test_parser.py
+
+def test_parse_evolution():
+    # The phase time columns written after the evolution
+    # data should be skipped unless they are requested
+    header = ["Population", "Trial energy", "Tau_nodes", "Diffusion time", "Psi_D time"]
+    rows   = [[100, -1.5, 0.1, 0.25, 0.5],
+              [102, -1.25, 0.1, 0.75, 1.0]]
+    with tempfile.TemporaryDirectory() as d:
+        filename = os.path.join(d, "evolution")
+        with open(filename, "w") as f:
+            f.write(",".join(header) + "\n")
+            for r in rows: f.write(",".join(str(v) for v in r) + "\n")
+
+        y_axes, data = parse_evolution(filename)
+        assert y_axes == header[:3]
+        assert [list(c) for c in data] == [[100, 102], [-1.5, -1.25], [0.1, 0.1]]
+
+        y_axes, data = parse_evolution(filename, phase_times=True)
+        assert y_axes == header
+        assert list(data[4]) == [0.5, 1.0]
+
+if __name__ == "__main__":
+    test_parse_evolution()
+    print("All parser tests passed")
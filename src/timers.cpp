@@ -0,0 +1,159 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <cmath>
+
+#include "catch.h"
+#include "timers.h"
+#include "params.h"
+#include "utils.h"
+
+// The time origin, the accumulated time in each phase, the phase
+// currently being timed and when it was last started/resumed
+static std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+static double phase_totals[PHASE_COUNT] = {0};
+static timer_phase current_phase = PHASE_OTHER;
+static double segment_start = 0;
+static bool trace_started = false;
+
+double wall_time()
+{
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - origin;
+    return t.count();
+}
+
+void start_wall_time()
+{
+    origin = std::chrono::steady_clock::now();
+    segment_start = 0;
+}
+
+const char* phase_name(timer_phase phase)
+{
+    switch(phase)
+    {
+        case PHASE_DIFFUSION:       return "Diffusion";
+        case PHASE_PSI_D:           return "Psi_D";
+        case PHASE_EXCHANGE:        return "Exchange";
+        case PHASE_RENORMALIZATION: return "Renormalization";
+        case PHASE_BRANCHING:       return "Branching";
+        case PHASE_LOAD_BALANCE:    return "Load balancing";
+        case PHASE_MPI_WAIT:        return "MPI wait";
+        case PHASE_OUTPUT:          return "Output";
+        default:                    return "Other";
+    }
+}
+
+scoped_timer :: scoped_timer(timer_phase phase)
+{
+    // Pause the enclosing phase and start this one
+    active = thread_count() == 1;
+    if (!active) return;
+
+    start = wall_time();
+    phase_totals[current_phase] += start - segment_start;
+    this->phase   = phase;
+    parent        = current_phase;
+    current_phase = phase;
+    segment_start = start;
+}
+
+scoped_timer :: ~scoped_timer()
+{
+    // Stop this phase and resume the enclosing one
+    if (!active) return;
+
+    double end = wall_time();
+    phase_totals[current_phase] += end - segment_start;
+    current_phase = parent;
+    segment_start = end;
+
+    if (params::trace) trace_event(phase_name(phase), start, end);
+}
+
+void take_phase_times(double* times)
+{
+    // Include the time in the current phase so far
+    double now = wall_time();
+    phase_totals[current_phase] += now - segment_start;
+    segment_start = now;
+
+    for (unsigned p=0; p<PHASE_COUNT; ++p)
+    {
+        times[p] = phase_totals[p];
+        phase_totals[p] = 0;
+    }
+}
+
+void begin_trace()
+{
+    // Start the trace file, naming this process
+    params::trace_file << "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << params::pid
+                       << ",\"args\":{\"name\":\"Process " << params::pid << "\"}}";
+    trace_started = true;
+}
+
+void trace_event(const char* name, double start, double end)
+{
+    // Write a complete event, with times in microseconds
+    if (!trace_started) begin_trace();
+    char event[256];
+    snprintf(event, sizeof(event),
+             ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":0}",
+             name, start*1e6, (end-start)*1e6, params::pid);
+    params::trace_file << event;
+}
+
+void end_trace()
+{
+    if (trace_started) params::trace_file << "\n]\n";
+    trace_started = false;
+}
+
+TEST_CASE("Timer tests", "[timers]")
+{
+    // Nested timers should exclude each others time
+    // and add up to the total time
+    auto sleep = [](double secs)
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double>(secs));
+    };
+
+    double times[PHASE_COUNT];
+    take_phase_times(times);
+    double start = wall_time();
+    {
+        scoped_timer outer(PHASE_DIFFUSION);
+        sleep(0.02);
+        {
+            scoped_timer inner(PHASE_PSI_D);
+            sleep(0.04);
+        }
+    }
+    take_phase_times(times);
+    double total = wall_time() - start;
+
+    double sum = 0;
+    for (unsigned p=0; p<PHASE_COUNT; ++p) sum += times[p];
+    REQUIRE(times[PHASE_DIFFUSION] >= 0.02);
+    REQUIRE(times[PHASE_PSI_D]     >= 0.04);
+    REQUIRE(fabs(sum - total) < 1e-3);
+}
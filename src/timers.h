@@ -0,0 +1,75 @@
+/*
+
+    XDMC
+    Copyright (C) Michael Hutcheon (email mjh261@cam.ac.uk)
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    For a copy of the GNU General Public License see <https://www.gnu.org/licenses/>.
+
+*/
+#ifndef __TIMERS__
+#define __TIMERS__
+
+// The phases of a DMC iteration that are timed
+// (PHASE_OTHER is time not spent in any other phase)
+enum timer_phase
+{
+    PHASE_DIFFUSION,
+    PHASE_PSI_D,
+    PHASE_EXCHANGE,
+    PHASE_RENORMALIZATION,
+    PHASE_BRANCHING,
+    PHASE_LOAD_BALANCE,
+    PHASE_MPI_WAIT,
+    PHASE_OUTPUT,
+    PHASE_OTHER,
+    PHASE_COUNT
+};
+
+// Times the enclosing scope (in wall-clock time) as the given
+// phase. Time spent in timers nested within this one is excluded,
+// so that the times of all of the phases add up to the total time.
+// Only scopes outside of parallel regions are timed. If tracing
+// is enabled, an event is also written to the trace file.
+class scoped_timer
+{
+public:
+    scoped_timer(timer_phase phase);
+    ~scoped_timer();
+
+private:
+    timer_phase phase;
+    timer_phase parent;
+    double start;
+    bool active;
+};
+
+// The wall-clock time in seconds since start_wall_time was called
+// (which is called on all processes together, after MPI startup)
+double wall_time();
+void start_wall_time();
+
+// The name of a phase, e.g "Psi_D"
+const char* phase_name(timer_phase phase);
+
+// Sets times[p] to the time spent in phase p since the
+// last call, for every phase p < PHASE_COUNT
+void take_phase_times(double* times);
+
+// Write an event, running from start to end (see wall_time), to
+// the trace file (params::trace_file) in the Chrome trace format
+// (viewable in chrome://tracing or https://ui.perfetto.dev)
+void trace_event(const char* name, double start, double end);
+void begin_trace();
+void end_trace();
+
+#endif
@@ -1,6 +1,10 @@
 #include <sstream>
 #include "utils.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 // Convert a length of time in seconds to
 // a human readable string
 std::string seconds_to_human(int secs)
@@ -16,3 +20,21 @@ std::string seconds_to_human(int secs)
        << mins << "m " << secs << "s";
     return ss.str();
 }
+
+unsigned thread_id()
+{
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+}
+
+unsigned thread_count()
+{
+#ifdef _OPENMP
+    return omp_get_num_threads();
+#else
+    return 1;
+#endif
+}
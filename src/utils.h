@@ -7,4 +7,9 @@
 // a human-readable string
 std::string seconds_to_human(int secs);
 
+// The id of the calling thread within the current
+// parallel region, and the number of threads in it
+unsigned thread_id();
+unsigned thread_count();
+
 #endif
@@ -18,6 +18,7 @@
 */
 
 #include <sstream>
+#include <algorithm>
 #include <mpi.h>
 
 #include "catch.h"
@@ -26,49 +27,79 @@
 #include "dmc_math.h"
 #include "walker.h"
 #include "params.h"
+#include "mpi_profile.h"
 
 // Used to track the number of constructred walkers
 // to ensure that we delete them all again properly
 int walker :: constructed_count = 0;
 
-walker :: walker()
+// Used to track the number of times walker storage had
+// to be allocated from the heap (reset every iteration)
+int walker :: allocation_count = 0;
+
+// Coordinate blocks freed by previous walkers, which
+// are recycled when constructing new walkers
+std::vector<double*> free_coord_blocks;
+
+double* walker :: allocate_coords()
 {
-    // Default constructor:
-    // Setup the walker with the particles
-    // that describe the system.
-    ++ constructed_count;
-    this->weight = 1;
-    for (unsigned i=0; i<params::template_system.size(); ++i)
-        this->particles.push_back(params::template_system[i]->copy());
+    // Get a block to store a walker configuration in,
+    // reusing a previously freed block if possible
+    if (free_coord_blocks.size() > 0)
+    {
+        double* x = free_coord_blocks.back();
+        free_coord_blocks.pop_back();
+        return x;
+    }
+
+    ++ allocation_count;
+    return new double[coord_count()];
+}
+
+void walker :: free_coords(double* x)
+{
+    // Return a configuration block for reuse
+    free_coord_blocks.push_back(x);
 }
 
-walker :: walker(std::vector<particle*> particles)
+void walker :: free_pool()
 {
-    // Constructor to create a walker explicitly from
-    // a collection of particles
+    // Actually free the recycled configuration blocks
+    for (unsigned i=0; i<free_coord_blocks.size(); ++i)
+        delete[] free_coord_blocks[i];
+    free_coord_blocks.clear();
+}
+
+walker :: walker()
+{
+    // Default constructor:
+    // Setup the walker with the particle
+    // positions that describe the system.
     ++ constructed_count;
     this->weight = 1;
-    this->particles = particles;
+    this->coords = allocate_coords();
+    for (unsigned i=0; i<particle_count(); ++i)
+        for (unsigned j=0; j<params::dimensions; ++j)
+            this->coords[i*params::dimensions+j] = params::template_system[i]->coords[j];
 }
 
 walker :: ~walker()
 {
-    // Clear up memory (delete all the particles).
+    // Clear up memory (recycle the coordinates).
     -- constructed_count;
-    for (unsigned i=0; i<particles.size(); ++i)
-        delete(particles[i]);
+    free_coords(coords);
 }
 
-
 walker* walker :: copy()
 {
     // Return an exact copy of this walker
-    // (copy each of the particles and the weight)
-    std::vector<particle*> copied_particles;
-    for (unsigned i=0; i<particles.size(); ++i)
-        copied_particles.push_back(particles[i]->copy());
-    walker* copy = new walker(copied_particles);
+    // (copy the coordinates and the weight)
+    walker* copy = new walker();
+    for (unsigned i=0; i<coord_count(); ++i)
+        copy->coords[i] = this->coords[i];
     copy->weight = this->weight;
+    copy->potential_dirty = this->potential_dirty;
+    copy->last_potential  = this->last_potential;
     return copy;
 }
 
@@ -84,6 +115,8 @@ walker* walker :: branch_copy()
 
 walker* walker :: mpi_copy(walker* to_copy, int root_pid)
 {
+    mpi_call_site site("walker::mpi_copy");
+
     // Create a copy of a given walker across mpi 
     // processes (i.e copy a walker from the given
     // root process).
@@ -101,8 +134,9 @@ walker* walker :: mpi_copy(walker* to_copy, int root_pid)
         copy = new walker();
 
     // Distribute the walker coordinates across processes
-    for (unsigned i=0; i<copy->particles.size(); ++i)
-        MPI_Bcast(copy->particles[i]->coords, params::dimensions, MPI_DOUBLE, root_pid, MPI_COMM_WORLD);
+    // (these are contiguous, so need only one message)
+    MPI_Bcast(copy->coords, coord_count(), MPI_DOUBLE, root_pid, MPI_COMM_WORLD);
+    copy->potential_dirty = true;
 
     // Distribute the walker weight across processes
     MPI_Bcast(&copy->weight, 1, MPI_DOUBLE, root_pid, MPI_COMM_WORLD);
@@ -114,11 +148,11 @@ std::string walker :: summary()
     // Return a summary of this walker
     std::stringstream ss;
     ss << "Weight: " << this->weight << "\n";
-    for (unsigned i=0; i<particles.size(); ++i)
+    for (unsigned i=0; i<particle_count(); ++i)
     {
         ss << "    Particle " << i << ":";
         for (unsigned j=0; j<params::dimensions; ++j)
-            ss << particles[i]->coords[j] << " ";
+            ss << coords[i*params::dimensions+j] << " ";
         ss << "\n";
     }
     return ss.str();
@@ -126,26 +160,34 @@ std::string walker :: summary()
 
 void walker :: reflect_to_irreducible()
 {
-    // Reflect this walker using exchange symmetry until
+    reflect_to_irreducible(this->coords);
+}
+
+void walker :: reflect_to_irreducible(double* x)
+{
+    // Reflect the configuration x using exchange symmetry until
     // we're in the irreducible section of configuration space
     // doesn't change the weight at all (even for fermionic exchanges)
+    unsigned d = params::dimensions;
     while(true)
     {
         bool swap_made = false;
 
-        // Cast to int in case particles.size() = 0
-        for (int i=0; i<int(particles.size())-1; ++i)
+        // Cast to int in case particle_count() = 0
+        for (int i=0; i<int(particle_count())-1; ++i)
         {
-            particle* p1 = particles[i];
-            particle* p2 = particles[i+1];
+            particle* p1 = params::template_system[i];
+            particle* p2 = params::template_system[i+1];
             if (p1->exchange_symmetry(p2) == 0)
                 continue;
 
             // These particles should be swapped if they're
             // in the wrong order (sort by increasing coordinates)
+            double* x1 = x + i*d;
+            double* x2 = x + (i+1)*d;
             bool swap = true;
-            for (unsigned j=0; j < params::dimensions; ++j)
-                if (p1->coords[j] < p2->coords[j])
+            for (unsigned j=0; j < d; ++j)
+                if (x1[j] < x2[j])
                 {
                     // These are in the right order
                     swap = false;
@@ -155,8 +197,12 @@ void walker :: reflect_to_irreducible()
             if (swap)
             {
                 // Swap these particles
-                particles[i]   = p2;
-                particles[i+1] = p1;
+                for (unsigned j=0; j < d; ++j)
+                {
+                    double tmp = x1[j];
+                    x1[j] = x2[j];
+                    x2[j] = tmp;
+                }
                 swap_made = true;
             }
         }
@@ -168,8 +214,13 @@ void walker :: reflect_to_irreducible()
 
 bool walker :: crossed_nodal_surface(walker* other)
 {
-    // Returns true if, to get to the other walker
-    // we must cross a nodal surface
+    return crossed_nodal_surface(this->coords, other->coords);
+}
+
+bool walker :: crossed_nodal_surface(double* x_before, double* x_after)
+{
+    // Returns true if, to get from x_before to
+    // x_after we must cross a nodal surface
 
     // Cant tell in > 1D
     if (params::dimensions > 1)
@@ -189,13 +240,8 @@ bool walker :: crossed_nodal_surface(walker* other)
             unsigned j = eg->pairs[m].second;
 
             // Check if this pair has crossed it's nodal surface
-            particle* pi1 = particles[i];
-            particle* pj1 = particles[j];
-            particle* pi2 = other->particles[i];
-            particle* pj2 = other->particles[j];
-
-            double d1 = pi1->coords[0] - pj1->coords[0];
-            double d2 = pi2->coords[0] - pj2->coords[0];
+            double d1 = x_before[i] - x_before[j];
+            double d2 = x_after[i]  - x_after[j];
 
             if (sign(d1) != sign(d2))
                 return true;
@@ -211,42 +257,255 @@ double walker :: potential()
     if (!potential_dirty)
         return last_potential;
     
+    last_potential  = potential(this->coords);
+    potential_dirty = false;
+    return last_potential;
+}
+
+template<unsigned D>
+double potential_kernel(double* x)
+{
     // Evaluate the potential of the system
-    // in the configuration described by this walker
-    last_potential = 0;
-    for (unsigned i = 0; i < particles.size(); ++i)
+    // in the configuration x
+    unsigned d = D > 0 ? D : params::dimensions;
+    double pot = 0;
+    for (unsigned i = 0; i < walker::particle_count(); ++i)
     {
+        particle* pi = params::template_system[i];
+
         // Sum up external potential contributions
         for (unsigned j=0; j<params::potentials.size(); ++j)
-            last_potential += params::potentials[j]->potential(particles[i]);
+            pot += params::potentials[j]->potential(pi, x + i*d);
 
         // Particle-particle interactions
         // note j<i => no double counting
         for (unsigned j=0; j<i; ++j)
-            last_potential += particles[i]->interaction(particles[j]);
+        {
+            double r = sqrt(sq_distance<D>(x + i*d, x + j*d, d));
+            pot += pi->interaction(params::template_system[j], r);
+        }
     }
+    return pot;
+}
 
-    potential_dirty = false;
-    return last_potential;
+template<unsigned D>
+void diffuse_kernel(double* x_from, double* x_to, unsigned count, double tau)
+{
+    // Set the count configurations in x_to to those in x_from with
+    // all of the particles diffused, moving each coordinate by an
+    // amount sampled from a normal distribution with variance
+    // tau/mass (x_to may be the same as x_from). The displacements
+    // for the whole block are sampled in one batch.
+    unsigned d  = D > 0 ? D : params::dimensions;
+    unsigned np = walker::particle_count();
+    unsigned cc = np * d;
+
+    static thread_local std::vector<double> dx;
+    if (dx.size() < count * cc) dx.resize(count * cc);
+    rand_normal(&dx[0], count * cc);
+
+    double sigma[np];
+    for (unsigned i=0; i<np; ++i)
+        sigma[i] = sqrt(tau/params::template_system[i]->mass);
+
+    for (unsigned n=0; n<count; ++n)
+        for (unsigned i=0; i<np; ++i)
+        {
+            unsigned o = n*cc + i*d;
+            for (unsigned j=0; j<d; ++j)
+                x_to[o+j] = x_from[o+j] + sigma[i] * dx[o+j];
+        }
+}
+
+// The largest exchange group for which exchange_diffusive_gf
+// enumerates the permutations explicitly (for larger groups it is
+// cheaper to evaluate a determinant/permanent)
+const unsigned exchange_enumeration_max = 4;
+
+template<unsigned D, bool parts>
+void exchange_diffusive_gf_kernel(double* x, double* y, double tau, double* ret)
+{
+    // Evaluate the exchange-diffusive greens function
+    // sum_{P_i} G(y, P_i x, tau) \sign(P_i), returning
+    // the positive and negative contributions in ret[0]
+    // and ret[1] respectively. If !parts only the signed
+    // sum, ret[0] - ret[1], is correct (which is cheaper
+    // to evaluate for large groups of fermions).
+    unsigned d = D > 0 ? D : params::dimensions;
+    ret[0] = 0;
+    ret[1] = 0;
+    for (unsigned n=0; n<params::exchange_groups.size(); ++n)
+    {
+        exchange_group* eg = params::exchange_groups[n];
+
+        double r2_unpermuted = 0;
+        for (unsigned i=0; i<walker::particle_count(); ++i)
+        {
+            // Check if the i^th particle is
+            // permuted by this group 
+            bool is_permuted = false;
+            for (unsigned j=0; j<eg->particles.size(); ++j)
+                if (eg->particles[j] == i)
+                {
+                    is_permuted = true;
+                    break;
+                }
+            if (is_permuted)
+                continue;
+
+            // Sum r^2 for particles that are not permuted
+            r2_unpermuted += sq_distance<D>(x + i*d, y + i*d, d);
+        }
+
+        unsigned m_count = eg->particles.size();
+        if (m_count > exchange_enumeration_max)
+        {
+            // The sum over permutations of the product of single-particle
+            // greens functions is the permanent of the matrix
+            // a_ij = exp(-|x_{p_j} - y_{p_i}|^2/2tau) and the sum signed
+            // by the parity of the permutation is it's determinant
+            static thread_local std::vector<double> a;
+            a.resize(m_count*m_count);
+            for (unsigned i=0; i<m_count; ++i)
+                for (unsigned j=0; j<m_count; ++j)
+                {
+                    double r2 = sq_distance<D>(x + eg->particles[j]*d,
+                                               y + eg->particles[i]*d, d);
+                    a[i*m_count+j] = fexp(-r2/(2*tau));
+                }
+
+            double norm = fexp(-r2_unpermuted/(2*tau))/sqrt(2*PI*tau);
+            if (eg->sign > 0)
+            {
+                // Bosons, all permutations contribute positively
+                ret[0] += norm * permanent(&a[0], m_count);
+                continue;
+            }
+
+            // Fermions, even permutations contribute positively
+            // and odd permutations contribute negatively. The
+            // permanent is only needed to split the determinant
+            // into the two (determinant overwrites a, so is last).
+            if (!parts)
+            {
+                double det = determinant(&a[0], m_count);
+                ret[det > 0 ? 0 : 1] += norm * fabs(det);
+                continue;
+            }
+            double perm = permanent(&a[0], m_count);
+            double det  = determinant(&a[0], m_count);
+            ret[0] += norm * std::max(perm + det, 0.0)/2;
+            ret[1] += norm * std::max(perm - det, 0.0)/2;
+            continue;
+        }
+
+        // Loop over permutations
+        unsigned* unperm = &eg->particles[0];
+        unsigned perm[eg->perms->elements()];
+        for (unsigned m=0; m<eg->perms->size(); ++m)
+        {
+            double perm_sign = eg->perms->unrank(m, perm);
+            double r2        = r2_unpermuted;
+
+            // Add the contribution to r^2 from the permuted particles
+            for (unsigned i=0; i<eg->perms->elements(); ++i)
+            {
+                unsigned j = perm[i];
+                unsigned k = unperm[i];
+                r2   += sq_distance<D>(x + j*d, y + k*d, d);
+            }
+
+            // Sum the greens functions
+            double gf = fexp(-r2/(2*tau))/sqrt(2*PI*tau);
+            if (eg->weight_mult(perm_sign) > 0) ret[0] += gf;
+            else ret[1] += gf;
+        }
+    }
+}
+
+// The kernels specialised to the number of dimensions
+// (use the generic kernels until select_kernels is called)
+double (*selected_potential_kernel)(double*)               = potential_kernel<0>;
+void   (*selected_diffuse_kernel)(double*, double*, unsigned, double) = diffuse_kernel<0>;
+void   (*selected_exchange_gf_kernel)(double*, double*, double, double*) = exchange_diffusive_gf_kernel<0, true>;
+void   (*selected_exchange_gf_signed_kernel)(double*, double*, double, double*) = exchange_diffusive_gf_kernel<0, false>;
+
+void walker :: select_kernels()
+{
+    // Select the kernels specialised to the
+    // number of dimensions that we are using
+    switch(params::dimensions)
+    {
+        case 1:
+            selected_potential_kernel   = potential_kernel<1>;
+            selected_diffuse_kernel     = diffuse_kernel<1>;
+            selected_exchange_gf_kernel        = exchange_diffusive_gf_kernel<1, true>;
+            selected_exchange_gf_signed_kernel = exchange_diffusive_gf_kernel<1, false>;
+            break;
+        case 2:
+            selected_potential_kernel   = potential_kernel<2>;
+            selected_diffuse_kernel     = diffuse_kernel<2>;
+            selected_exchange_gf_kernel        = exchange_diffusive_gf_kernel<2, true>;
+            selected_exchange_gf_signed_kernel = exchange_diffusive_gf_kernel<2, false>;
+            break;
+        case 3:
+            selected_potential_kernel   = potential_kernel<3>;
+            selected_diffuse_kernel     = diffuse_kernel<3>;
+            selected_exchange_gf_kernel        = exchange_diffusive_gf_kernel<3, true>;
+            selected_exchange_gf_signed_kernel = exchange_diffusive_gf_kernel<3, false>;
+            break;
+        default:
+            selected_potential_kernel   = potential_kernel<0>;
+            selected_diffuse_kernel     = diffuse_kernel<0>;
+            selected_exchange_gf_kernel        = exchange_diffusive_gf_kernel<0, true>;
+            selected_exchange_gf_signed_kernel = exchange_diffusive_gf_kernel<0, false>;
+    }
+}
+
+double walker :: potential(double* x)
+{
+    return selected_potential_kernel(x);
 }
 
 void walker :: diffuse(double tau=params::tau)
 {
-    // Diffuse all of the particles
-    for (unsigned i=0; i<particles.size(); ++i)
-        particles[i]->diffuse(tau);
+    diffuse(this->coords, tau);
     
     // Particles have moved => potential has changed
     potential_dirty = true;
 }
 
+void walker :: diffuse(double* x, double tau)
+{
+    diffuse(x, x, tau);
+}
+
+void walker :: diffuse(double* x_from, double* x_to, double tau)
+{
+    selected_diffuse_kernel(x_from, x_to, 1, tau);
+}
+
+void walker :: diffuse(double* x_from, double* x_to, unsigned count, double tau)
+{
+    selected_diffuse_kernel(x_from, x_to, count, tau);
+}
+
 void walker :: exchange()
 {
-    // Apply random exchange moves to particles
     // Note: because only identical particles
     // are exchanged, the potential remains the
     // same => we do not need to set the potential_dirty
     // flag.
+    this->weight *= exchange(this->coords);
+}
+
+double walker :: exchange(double* x)
+{
+    // Apply random exchange moves to the particles
+    // in configuration x, returns the resulting
+    // multiplier for the walker weight.
+    unsigned d = params::dimensions;
+    double weight_mult = 1.0;
 
     for(unsigned n=0; n<params::exchange_groups.size(); ++n)
     {
@@ -257,162 +516,145 @@ void walker :: exchange()
         if (params::full_exchange)
         {
             // Pick a random permutation
-            unsigned i = rand() % eg->perms->size();
+            unsigned perm[eg->perms->elements()];
+            double perm_sign = eg->perms->sample(perm);
 
             // Record where the old particles were
-            std::vector<particle*> old_particles;
-            for (unsigned j=0; j<particles.size(); ++j)
-                old_particles.push_back(particles[j]);
+            double old_x[coord_count()];
+            for (unsigned j=0; j<coord_count(); ++j)
+                old_x[j] = x[j];
 
             // Put them into their permuted positions
             for (unsigned j=0; j<eg->perms->elements(); ++j)
             {
-                unsigned k_unperm = (*eg->perms)[0][j];
-                unsigned k_perm   = (*eg->perms)[i][j];
-                particles[k_perm] = old_particles[k_unperm];
+                unsigned k_unperm = eg->particles[j];
+                unsigned k_perm   = perm[j];
+                for (unsigned k=0; k<d; ++k)
+                    x[k_perm*d+k] = old_x[k_unperm*d+k];
             }
 
             // Update the weight according to the sign of the permutation
-            this->weight *= eg->weight_mult(i);
+            weight_mult *= eg->weight_mult(perm_sign);
         }
         else
         {
             // Pick a random exchangable pair (i.e exchange operator)
-            unsigned i = rand() % eg->pairs.size();
-            particle* p1 = particles[eg->pairs[i].first];
-            particle* p2 = particles[eg->pairs[i].second];
+            unsigned i = rand_int(eg->pairs.size());
+            double* x1 = x + eg->pairs[i].first  * d;
+            double* x2 = x + eg->pairs[i].second * d;
 
             // Exchange them 
-            this->weight *= double(eg->sign);
-            p1->exchange(p2);
+            weight_mult *= double(eg->sign);
+            for (unsigned k=0; k<d; ++k)
+            {
+                double tmp = x1[k];
+                x1[k] = x2[k];
+                x2[k] = tmp;
+            }
          }
     }
+
+    return weight_mult;
 }
 
 void walker :: change_sign()
+{
+    this->weight *= change_sign(this->coords);
+}
+
+double walker :: change_sign(double* x)
 {
     // Pick a random exchange group with negative sign
-    unsigned group = rand() % params::exchange_groups.size();
+    unsigned group = rand_int(params::exchange_groups.size());
     exchange_group* eg = params::exchange_groups[group];
     if (eg->sign >= 0) throw "Not implemented!";
 
     // Pick a random pair of particles from that exchange group
-    unsigned pair = rand() % eg->pairs.size();
-    particle* p1  = particles[eg->pairs[pair].first];
-    particle* p2  = particles[eg->pairs[pair].second];
+    unsigned d    = params::dimensions;
+    unsigned pair = rand_int(eg->pairs.size());
+    double* x1    = x + eg->pairs[pair].first  * d;
+    double* x2    = x + eg->pairs[pair].second * d;
 
     // Make the corresponding exchange move
-    this->weight *= double(eg->sign);
-    p1->exchange(p2);
+    for (unsigned k=0; k<d; ++k)
+    {
+        double tmp = x1[k];
+        x1[k] = x2[k];
+        x2[k] = tmp;
+    }
+    return double(eg->sign);
 }
 
 double walker :: sq_distance_to(walker* other)
 {
     // Return the squared distance in configuration space
     // between these two walkers: |x_this - x_other|^2 
-    double r2 = 0;
-    for (unsigned i=0; i<particles.size(); ++i)
-        r2 += particles[i]->sq_distance_to(other->particles[i]);
-    return r2;
+    return sq_distance(this->coords, other->coords);
 }
 
 double walker :: diffusive_greens_function(walker* other, double tau)
 {
-    // Evaluate the diffusive greens function of this walker
-    // at the configuration of the other walker
-    double r2 = this->sq_distance_to(other);
-    return fexp(-r2/(2*tau))/sqrt(2*PI*tau);
+    return diffusive_greens_function(this->coords, other->coords, tau);
 }
 
-double* walker :: exchange_diffusive_gf(walker* other, double tau)
+double walker :: diffusive_greens_function(double* x, double* y, double tau)
 {
-    // Evaluate the exchange-diffusive greens function
-    // sum_{P_i} G(other, P_i this, tau) \sign(P_i).
-    // Note this will ignore the weight of other, and
-    // use only the configuration.
-    double* ret = new double[2];
-    ret[0] = 0;
-    ret[1] = 0;
-    for (unsigned n=0; n<params::exchange_groups.size(); ++n)
-    {
-        exchange_group* eg = params::exchange_groups[n];
-
-        double r2_unpermuted = 0;
-        for (unsigned i=0; i<particles.size(); ++i)
-        {
-            // Check if the i^th particle is
-            // permuted by this group 
-            bool is_permuted = false;
-            for (unsigned j=0; j<eg->perms->elements(); ++j)
-                if ((*eg->perms)[0][j] == i)
-                {
-                    is_permuted = true;
-                    break;
-                }
-            if (is_permuted)
-                continue;
-
-            // Sum r^2 for particles that are not permuted
-            r2_unpermuted += particles[i]->sq_distance_to(other->particles[i]);
-        }
+    // Evaluate the diffusive greens function of 
+    // configuration x at the configuration y
+    double r2 = sq_distance(x, y);
+    return fexp(-r2/(2*tau))/sqrt(2*PI*tau);
+}
 
-        // Loop over permutations
-        unsigned* unperm = (*eg->perms)[0];
-        for (unsigned m=0; m<eg->perms->size(); ++m)
-        {
-            unsigned* perm = (*eg->perms)[m];
-            double r2      = r2_unpermuted;
+void walker :: exchange_diffusive_gf(walker* other, double* gf, double tau)
+{
+    exchange_diffusive_gf(this->coords, other->coords, tau, gf);
+}
 
-            // Add the contribution to r^2 from the permuted particles
-            for (unsigned i=0; i<eg->perms->elements(); ++i)
-            {
-                unsigned j = perm[i];
-                unsigned k = unperm[i];
-                r2   += particles[j]->sq_distance_to(other->particles[k]);
-            }
+void walker :: exchange_diffusive_gf(double* x, double* y, double tau, double* ret)
+{
+    selected_exchange_gf_kernel(x, y, tau, ret);
+}
 
-            // Sum the greens functions
-            double gf = fexp(-r2/(2*tau))/sqrt(2*PI*tau);
-            if (eg->weight_mult(m) > 0) ret[0] += gf;
-            else ret[1] += gf;
-        }
-    }
-    return ret;
+double walker :: exchange_diffusive_gf(double* x, double* y, double tau)
+{
+    // The signed sum of the above, ret[0] - ret[1]
+    double ret[2];
+    selected_exchange_gf_signed_kernel(x, y, tau, ret);
+    return ret[0] - ret[1];
 }
 
 void walker :: write_coords(output_file& file)
+{
+    write_coords(file, this->weight, this->coords);
+}
+
+void walker :: write_coords(output_file& file, double weight, double* x)
 {
     // Write the walker wavefunction in the form
     // [weight: x1, y1, z1 ...; x2, y2, z2 ...; ...]
     // where x1 is the x coord of the first particle etc
-    file << this->weight << ":";
-    for (unsigned i=0; i<particles.size(); ++i)
+    unsigned d = params::dimensions;
+    file << weight << ":";
+    for (unsigned i=0; i<particle_count(); ++i)
     {
-        for (unsigned j=0; j<params::dimensions; ++j)
+        for (unsigned j=0; j<d; ++j)
         {
-            file << particles[i]->coords[j];
-            if (j != params::dimensions - 1)
+            file << x[i*d+j];
+            if (j != d - 1)
                 file << ",";
         }
-        if (i != particles.size() - 1)
+        if (i != particle_count() - 1)
             file << ";";
     }
     file << "\n";
 }
 
-unsigned walker :: particle_count()
-{
-    // Return the number of particles
-    return particles.size();
-}
-
 bool walker :: compare(walker* other)
 {
     // Returns false if these walkers are not identical
     // in some way (for testing purposes)
     if (this->sq_distance_to(other) != 0) return false;
     if (this->weight != other->weight) return false;
-    if (this->particle_count() != other->particle_count()) return false;
     return true;
 }
 
@@ -434,9 +676,94 @@ TEST_CASE("Basic walker tests", "[walker]")
         walker* w = params::pid == 0 ? w1 : nullptr;
         walker* wc = walker::mpi_copy(w, 0);
         REQUIRE(wc->compare(w1));
+        delete wc;
     }
 
     delete w1;
     delete w2;
 }
 
+TEST_CASE("Exchange greens function tests", "[walker]")
+{
+    // Five identical fermions (enough to use determinants
+    // rather than enumerating permutations), in a
+    // temporary system, restoring the parameters after
+    unsigned dimensions = params::dimensions;
+    std::string input = "dimensions 2\n";
+    for (unsigned i=0; i<5; ++i)
+        input += "particle f 1 0 1 0 0\n";
+    std::istringstream input_stream(input);
+    params::read_input(input_stream);
+    walker::select_kernels();
+    REQUIRE(params::exchange_groups.size() == 1);
+
+    // The signed sum should match that of the
+    // even and odd contributions evaluated separately
+    for (unsigned n=0; n<16; ++n)
+    {
+        double x[10], y[10];
+        for (unsigned j=0; j<10; ++j)
+        {
+            x[j] = rand_normal(1.0);
+            y[j] = rand_normal(1.0);
+        }
+
+        double parts[2];
+        walker::exchange_diffusive_gf(x, y, 1.0, parts);
+        double signed_sum = walker::exchange_diffusive_gf(x, y, 1.0);
+        REQUIRE(fabs(signed_sum - (parts[0] - parts[1])) <= 1e-12 * (parts[0] + parts[1]));
+    }
+
+    // For six identical fermions or bosons, the determinant/permanent
+    // evaluation should match an explicit sum over permutations
+    for (int half_spins=1; half_spins>=0; --half_spins)
+    {
+        std::string six = "dimensions 2\n";
+        for (unsigned i=0; i<6; ++i)
+            six += "particle q 1 0 " + std::to_string(half_spins) + " 0 0\n";
+        std::istringstream six_stream(six);
+        params::read_input(six_stream);
+        walker::select_kernels();
+        REQUIRE(params::exchange_groups.size() == 1);
+        REQUIRE(params::exchange_groups[0]->particles.size() == 6);
+        double sign = half_spins % 2 == 0 ? 1.0 : -1.0;
+
+        std::vector<unsigned> order = {0, 1, 2, 3, 4, 5};
+        permutations<unsigned> perms(order);
+        for (unsigned n=0; n<4; ++n)
+        {
+            double x[12], y[12];
+            for (unsigned j=0; j<12; ++j)
+            {
+                x[j] = rand_normal(1.0);
+                y[j] = rand_normal(1.0);
+            }
+
+            double expect[2] = {0, 0};
+            unsigned p[6];
+            for (unsigned m=0; m<perms.size(); ++m)
+            {
+                double perm_sign = perms.unrank(m, p);
+                double r2 = 0;
+                for (unsigned i=0; i<6; ++i)
+                    for (unsigned j=0; j<2; ++j)
+                        r2 += (x[p[i]*2+j] - y[i*2+j])*(x[p[i]*2+j] - y[i*2+j]);
+                double gf = exp(-r2/2)/sqrt(2*PI);
+                expect[(sign < 0 && perm_sign < 0) ? 1 : 0] += gf;
+            }
+
+            double parts[2];
+            double total = expect[0] + expect[1];
+            walker::exchange_diffusive_gf(x, y, 1.0, parts);
+            REQUIRE(fabs(parts[0] - expect[0]) <= 1e-10 * total);
+            REQUIRE(fabs(parts[1] - expect[1]) <= 1e-10 * total);
+            double signed_sum = walker::exchange_diffusive_gf(x, y, 1.0);
+            REQUIRE(fabs(signed_sum - (expect[0] - expect[1])) <= 1e-10 * total);
+        }
+    }
+
+    std::istringstream empty("");
+    params::read_input(empty);
+    params::dimensions = dimensions;
+    walker::select_kernels();
+}
@@ -27,20 +27,29 @@
 
 // The object used by the diffusion monte carlo algorithm
 // to represent a snapshot of the system.
+//
+// The configuration of a walker is stored as a single contiguous
+// block of coordinates, laid out as [particle][dimension]. The
+// static methods below act directly on such blocks, so that they
+// can also be applied to configurations stored inside of a
+// walker_collection (which stores many blocks back-to-back).
 class walker
 {
 public:
     walker();
     ~walker();
     static int constructed_count;
+    static int allocation_count;
 
     double weight = 1.0;
-    unsigned particle_count();
+    double* coords;
+    static unsigned particle_count();
+    static unsigned coord_count();
 
     double potential();
     double sq_distance_to(walker* other);
     double diffusive_greens_function(walker* other, double tau=params::tau);
-    double* exchange_diffusive_gf(walker* other, double tau=params::tau);
+    void exchange_diffusive_gf(walker* other, double* gf, double tau=params::tau);
 
     bool crossed_nodal_surface(walker* other);
     bool compare(walker* other);
@@ -56,18 +65,76 @@ public:
 
     void write_coords(output_file& file);
     std::string summary();
-private:
 
-    // The particles in this system snapshot
-    std::vector<particle*> particles;
+    // Kernels acting on the configuration block x
+    static double potential(double* x);
+    static double sq_distance(double* x, double* y);
+    template<unsigned D> static double sq_distance(double* x, double* y);
+    static double diffusive_greens_function(double* x, double* y, double tau);
+    static void exchange_diffusive_gf(double* x, double* y, double tau, double* gf);
+    static double exchange_diffusive_gf(double* x, double* y, double tau);
+    static bool crossed_nodal_surface(double* x_before, double* x_after);
+    static void diffuse(double* x, double tau);
+    static void diffuse(double* x_from, double* x_to, double tau);
+    static void diffuse(double* x_from, double* x_to, unsigned count, double tau);
+    static double exchange(double* x);
+    static double change_sign(double* x);
+    static void reflect_to_irreducible(double* x);
+    static void write_coords(output_file& file, double weight, double* x);
+
+    // Coordinate blocks are recycled between walkers
+    static double* allocate_coords();
+    static void free_coords(double* x);
+    static void free_pool();
+
+    // Select the kernels specialised to the number of dimensions
+    static void select_kernels();
 
-    // Create a walker from a given particle set 
-    walker(std::vector<particle*> particles);
+private:
 
     // True if the potential needs re-evaluating
     bool potential_dirty = true;
     double last_potential = 0;
 };
 
-#endif
+template<unsigned D>
+inline double walker :: sq_distance(double* x, double* y)
+{
+    // Return the squared distance in configuration space
+    // between the configurations x and y: |x - y|^2
+    // (summed particle-by-particle), specialised at compile
+    // time on the number of dimensions D (D = 0 => generic)
+    unsigned d = D > 0 ? D : params::dimensions;
+    unsigned n = particle_count();
+    double r2 = 0;
+    for (unsigned i=0; i<n; ++i)
+        r2 += ::sq_distance<D>(x + i*d, y + i*d, d);
+    return r2;
+}
+
+inline double walker :: sq_distance(double* x, double* y)
+{
+    // As above, for the number of dimensions we are using
+    // (kernels should call the specialisation directly)
+    switch(params::dimensions)
+    {
+        case 1:  return sq_distance<1>(x, y);
+        case 2:  return sq_distance<2>(x, y);
+        case 3:  return sq_distance<3>(x, y);
+        default: return sq_distance<0>(x, y);
+    }
+}
+
+inline unsigned walker :: particle_count()
+{
+    // Return the number of particles
+    return params::template_system.size();
+}
+
+inline unsigned walker :: coord_count()
+{
+    // Return the number of coordinates in a configuration
+    return params::template_system.size() * params::dimensions;
+}
 
+#endif
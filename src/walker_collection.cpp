@@ -19,6 +19,8 @@
 
 #include <sstream>
 #include <cmath>
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <mpi.h>
 
@@ -29,32 +31,98 @@
 #include "params.h"
 #include "mpi_utils.h"
 #include "utils.h"
+#include "timers.h"
+#include "mpi_profile.h"
+
+// Storage released by previous generations of walkers. This is
+// recycled (retaining its capacity) so that branching and copying
+// the collection need not allocate new memory once the population
+// has reached a steady state.
+template<class T>
+class storage_pool
+{
+public:
+
+    // Swap recycled storage into the (empty) vector v
+    void acquire(std::vector<T>& v)
+    {
+        if (spare.size() == 0) return;
+        v.swap(spare.back());
+        spare.pop_back();
+        v.clear();
+    }
+
+    // Return the storage of v to the pool, leaving v empty
+    void release(std::vector<T>& v)
+    {
+        if (v.capacity() == 0) return;
+        spare.push_back(std::vector<T>());
+        spare.back().swap(v);
+    }
+
+    // Ensure that v has space for n elements,
+    // recording any heap allocation required
+    void reserve(std::vector<T>& v, unsigned n)
+    {
+        if (v.capacity() >= n) return;
+        ++ walker::allocation_count;
+        v.reserve(2*n);
+    }
+
+private:
+    std::vector<std::vector<T>> spare;
+};
+
+storage_pool<double> double_pool;
+storage_pool<bool>   bool_pool;
 
 bool walker_collection :: propagate(walker_collection* walkers_last)
 {
     // Apply the stages of walker propagation
     // returns false if this iteration should be
     // reverted, because of population explosion etc...
+    //
+    // This collection is overwritten with the result of
+    // propagating walkers_last, which is left intact so
+    // that an iteration can be reverted without needing
+    // to copy the walkers beforehand.
+    begin_propagation(walkers_last);
+
+    // Index walkers_last, so that the diffused
+    // wavefunction need not visit every walker
+    walkers_last->build_index();
 
     // Diffusive moves involving G_D
-    make_diffusive_moves(walkers_last);
+    {
+        scoped_timer timer(PHASE_DIFFUSION);
+        make_diffusive_moves(walkers_last);
+    }
 
     // Exchange moves
-    make_exchange_moves();
+    {
+        scoped_timer timer(PHASE_EXCHANGE);
+        make_exchange_moves();
+    }
 
     // Renormalize by applying exp(E_T \delta\tau)
     // (work out E_T as well)
-    apply_renormalization();
+    {
+        scoped_timer timer(PHASE_RENORMALIZATION);
+        apply_renormalization();
+    }
 
     // Check for population explosion
-    for (unsigned n=0; n<walkers.size(); ++n)
-        if (fabs(walkers[n]->weight) > params::max_weight)
+    for (unsigned n=0; n<size(); ++n)
+        if (fabs(weights[n]) > params::max_weight)
             return false;
 
-    branch();
+    {
+        scoped_timer timer(PHASE_BRANCHING);
+        branch();
+    }
 
     // Check for population collapse
-    if (walkers.size() == 0)
+    if (size() == 0)
         return false;
 
     return true;
@@ -66,10 +134,16 @@ void walker_collection :: make_diffusive_moves(walker_collection* walkers_last)
     if (params::write_nodal_surface)
         params::nodal_surface_file << "# Iteration " << params::dmc_iteration << "\n";
     params::cancelled_weight = 0.0;
+
+    // Diffuse all of the walkers in one batch, the diffusion
+    // schemes below then decide what happens to each walker
+    diffuse(walkers_last, params::tau);
+    walkers_last->evaluate_potentials();
+    evaluate_potentials();
     
     // Carry out the specified diffusion scheme
     if (params::diffusion_scheme == "exact_1d")
-        diffuse_exact_1d();
+        diffuse_exact_1d(walkers_last);
     else if (params::diffusion_scheme == "max_seperation")
         diffuse_max_seperation(walkers_last);
     else if (params::diffusion_scheme == "max_seperation_mpi")
@@ -97,10 +171,9 @@ void walker_collection :: estimate_tau_nodes()
     else if (params::tau_nodes_estimator != "none") throw "Unkown tau_nodes estimator!";
 
     // Don't propagate NaN, or Inf values
+    // (tau_nodes is averaged across processes in write_output)
     if (std::isfinite(new_tau))
         params::tau_nodes = new_tau;
-
-    params::tau_nodes = mpi_average(params::tau_nodes);
 }
 
 void walker_collection :: make_exchange_moves()
@@ -112,11 +185,10 @@ void walker_collection :: make_exchange_moves()
         // average sign close to 0
         double positive_weight = 0;
         double negative_weight = 0;
-        for (unsigned n=0; n<walkers.size(); ++n)
+        for (unsigned n=0; n<size(); ++n)
         {
-            walker* w = walkers[n];
-            if (w->weight > 0) positive_weight += w->weight;
-            else negative_weight -= w->weight;
+            if (weights[n] > 0) positive_weight += weights[n];
+            else negative_weight -= weights[n];
         }
 
         double positive_exchange_prob = (positive_weight - negative_weight)/positive_weight;
@@ -130,30 +202,147 @@ void walker_collection :: make_exchange_moves()
         negative_exchange_prob *= 0.9;
 
         // Apply exchange moves with the above probabilities
-        for (unsigned n=0; n<walkers.size(); ++n)
+        #pragma omp parallel for schedule(static)
+        for (unsigned n=0; n<size(); ++n)
         {
-            walker* w = walkers[n];
-            double prob = w->weight < 0 ? negative_exchange_prob : positive_exchange_prob;
+            double prob = weights[n] < 0 ? negative_exchange_prob : positive_exchange_prob;
             if (rand_uniform() < prob)
-                w->change_sign();
+                weights[n] *= walker::change_sign(config(n));
         }
     }
 
     // Apply exchange moves to each of the walkers
-    for (unsigned n=0; n<walkers.size(); ++n)
-        walkers[n]->exchange();
+    // (only identical particles are exchanged, so
+    //  the potential remains the same)
+    #pragma omp parallel for schedule(static)
+    for (unsigned n=0; n<size(); ++n)
+        weights[n] *= walker::exchange(config(n));
+}
+
+void walker_collection :: build_index()
+{
+    // Build the spatial index over the walker configurations,
+    // so that the diffused wavefunction need only sum over
+    // nearby walkers, and forget the gauss transforms of any
+    // previous walkers (these are built as they are needed).
+    // The index is only valid until the walkers are next
+    // modified (see begin_propagation).
+    scoped_timer timer(PHASE_PSI_D);
+    if (params::psi_d_tolerance > 0)
+    {
+        index.build(size() > 0 ? config(0) : nullptr, size(), walker::coord_count());
+        max_abs_weight = 0;
+        for (unsigned n=0; n<size(); ++n)
+            max_abs_weight = std::max(max_abs_weight, fabs(weights[n]));
+    }
+    transforms_used = 0;
+    index_valid     = true;
+}
+
+double walker_collection :: psi_d_cutoff(double* x, double tau)
+{
+    // The squared distance from x beyond which the contributions
+    // of all N walkers to the diffused wavefunction add up to less
+    // than params::psi_d_tolerance times that of the nearest walker
+    // (and so less than the tolerance times psi_D, if the walkers
+    // all have the same sign):
+    // N max|w| exp(-r^2/2tau) < tolerance |w_nearest| exp(-r_nearest^2/2tau)
+    if (!indexed() || size() == 0) return INFINITY;
+    unsigned nearest;
+    double r2_nearest = index.nearest_sq_distance(x, &nearest);
+    double ratio      = size() * max_abs_weight / fabs(weights[nearest]);
+    return r2_nearest - 2*tau*log(params::psi_d_tolerance / ratio);
+}
+
+gauss_transform* walker_collection :: transform(double tau)
+{
+    // Return the fast gauss transform of the walkers for this tau,
+    // building it if needed (or nullptr if transforms are not in
+    // use). This must be called before evaluating the diffused
+    // wavefunction from several threads, so that the transform
+    // is not built by more than one of them.
+    if (params::psi_d_engine != "gauss_transform" || !index_valid)
+        return nullptr;
+
+    for (unsigned i=0; i<transforms_used; ++i)
+        if (transforms[i].h2 == 2*tau)
+            return &transforms[i];
+
+    scoped_timer timer(PHASE_PSI_D);
+    if (transforms_used == transforms.size())
+        transforms.push_back(gauss_transform());
+    gauss_transform* gt = &transforms[transforms_used++];
+    gt->build(size() > 0 ? config(0) : nullptr, size() > 0 ? &weights[0] : nullptr,
+              size(), walker::coord_count(), 2*tau, params::gauss_transform_tolerance);
+    return gt;
+}
+
+bool walker_collection :: transformed_wavefunction(
+    double* x, double tau, int self_index, double* psi)
+{
+    // Evaluate the contributions to the diffused wavefunction at x
+    // from the positive (psi[0]) and negative (psi[1]) walkers using
+    // a fast gauss transform. Returns false if the transform is not
+    // in use, or if direct summation would be faster.
+    gauss_transform* gt = transform(tau);
+    if (gt == nullptr || gt->direct) return false;
+
+    double norm = sqrt(2*PI*tau);
+    gt->evaluate(x, psi);
+    psi[0] /= norm;
+    psi[1] /= norm;
+
+    // Treat my own contribution to the
+    // greens function differently
+    if (self_index >= 0 && params::self_gf_strength != 1.0)
+    {
+        double r2 = walker::sq_distance(config(self_index), x);
+        double gf = (params::self_gf_strength - 1.0) * 
+                    fabs(weights[self_index]) * (fexp(-r2/(2*tau))/norm);
+        psi[weights[self_index] > 0 ? 0 : 1] += gf;
+    }
+    return true;
 }
 
+const unsigned walker_collection :: gf_block;
+
+template<unsigned D>
+void walker_collection :: diffusive_greens_functions(
+    double* x, double tau, unsigned n0, unsigned nb, double* gf)
+{
+    // Evaluate the diffusive greens function from the walkers
+    // n0, n0+1, ... n0+nb-1 to the configuration x, evaluating
+    // the exponentials together (see fexp)
+    unsigned stride = walker::coord_count();
+    double norm     = sqrt(2*PI*tau);
+    for (unsigned i=0; i<nb; ++i)
+        gf[i] = -walker::sq_distance<D>(&coords[(n0+i)*stride], x)/(2*tau);
+    fexp(gf, nb);
+    for (unsigned i=0; i<nb; ++i)
+        gf[i] /= norm;
+}
+
+template<unsigned D>
 double walker_collection :: diffused_wavefunction(
-    walker* c, double tau=params::tau, int self_index=-1)
+    double* x, double tau, int self_index)
 {
     // Evaluate the diffused wavefunction 
-    // at the configuration of c: 
-    // \psi_D(c) = \sum_i w_i G_D(c, x_i, dt)
-    double psi_d = 0;
-    for (unsigned n=0; n < walkers.size(); ++n)
+    // at the configuration x: 
+    // \psi_D(x) = \sum_i w_i G_D(x, x_i, dt)
+    double psi[2];
+    if (transformed_wavefunction(x, tau, self_index, psi))
+        return psi[0] - psi[1];
+
+    unsigned stride = walker::coord_count();
+    double norm     = sqrt(2*PI*tau);
+    double r2_max   = psi_d_cutoff(x, tau);
+    double psi_d    = 0;
+
+    // Add the contribution from the n^th walker
+    auto add_walker = [&](unsigned n)
     {
-        walker* w = walkers[n];
+        double r2 = walker::sq_distance<D>(&coords[n*stride], x);
+        if (r2 > r2_max) return;
 
         // Treat my own contribution to the
         // greens function differently
@@ -161,22 +350,60 @@ double walker_collection :: diffused_wavefunction(
         if (int(n) == self_index) 
             amp = params::self_gf_strength;
 
-        psi_d += amp * w->weight * w->diffusive_greens_function(c, tau);
+        psi_d += amp * weights[n] * (fexp(-r2/(2*tau))/norm);
+    };
+
+    if (indexed())
+    {
+        index.for_each_candidate(x, r2_max, add_walker);
+        return psi_d;
+    }
+
+    // Sum over every walker, a block at a time
+    double gf[gf_block];
+    for (unsigned n0=0; n0 < size(); n0 += gf_block)
+    {
+        unsigned nb = std::min(gf_block, size()-n0);
+        diffusive_greens_functions<D>(x, tau, n0, nb, gf);
+        for (unsigned i=0; i<nb; ++i)
+        {
+            unsigned n  = n0 + i;
+            double  amp = 1.0;
+            if (int(n) == self_index) 
+                amp = params::self_gf_strength;
+
+            psi_d += amp * weights[n] * gf[i];
+        }
     }
     return psi_d;
 }
 
-double* walker_collection :: diffused_wavefunction_signed(
-    walker* c, double tau=params::tau, int self_index=-1)
+template<unsigned D>
+void walker_collection :: diffused_wavefunction_signed(
+    double* x, double weight, double* ret, double tau, int self_index)
 {
     // Evaluate the diffused wavefunction as components whos sign
-    // matches c and those that do not
-    double* ret = new double[2];
+    // matches that of a walker at x with the given weight and
+    // those that do not
+    double psi[2];
+    if (transformed_wavefunction(x, tau, self_index, psi))
+    {
+        ret[0] = weight > 0 ? psi[0] : psi[1];
+        ret[1] = weight > 0 ? psi[1] : psi[0];
+        return;
+    }
+
+    unsigned stride = walker::coord_count();
+    double norm     = sqrt(2*PI*tau);
+    double r2_max   = psi_d_cutoff(x, tau);
     ret[0] = 0; // Same sign
     ret[1] = 0; // Opposite sign
-    for (unsigned n=0; n < walkers.size(); ++n)
+
+    // Add the contribution from the n^th walker
+    auto add_walker = [&](unsigned n)
     {
-        walker* w = walkers[n];
+        double r2 = walker::sq_distance<D>(&coords[n*stride], x);
+        if (r2 > r2_max) return;
 
         // Treat my own contribution to the
         // greens function differently
@@ -184,38 +411,223 @@ double* walker_collection :: diffused_wavefunction_signed(
         if (int(n) == self_index) 
             amp = params::self_gf_strength;
 
-        double gf = amp * fabs(w->weight) * w->diffusive_greens_function(c, tau);
-        if (sign(w->weight/c->weight) == 1) ret[0] += gf;
+        double gf = amp * fabs(weights[n]) * (fexp(-r2/(2*tau))/norm);
+        if (sign(weights[n]/weight) == 1) ret[0] += gf;
         else ret[1] += gf;
+    };
+
+    if (indexed())
+    {
+        index.for_each_candidate(x, r2_max, add_walker);
+        return;
+    }
+
+    // Sum over every walker, a block at a time
+    double gf[gf_block];
+    for (unsigned n0=0; n0 < size(); n0 += gf_block)
+    {
+        unsigned nb = std::min(gf_block, size()-n0);
+        diffusive_greens_functions<D>(x, tau, n0, nb, gf);
+        for (unsigned i=0; i<nb; ++i)
+        {
+            unsigned n  = n0 + i;
+            double  amp = 1.0;
+            if (int(n) == self_index) 
+                amp = params::self_gf_strength;
+
+            double g = amp * fabs(weights[n]) * gf[i];
+            if (sign(weights[n]/weight) == 1) ret[0] += g;
+            else ret[1] += g;
+        }
+    }
+}
+
+void walker_collection :: diffused_wavefunction_batch(
+    walker_collection* queries, double tau, std::vector<double>& psi)
+{
+    // Evaluate the diffused wavefunction at every configuration in
+    // queries, seperated into the contributions from the positive
+    // (psi[2n]) and negative (psi[2n+1]) walkers in this collection.
+    // The n^th query is treated as the n^th walker when applying
+    // params::self_gf_strength, for unbatched psi[0]-psi[1] = 
+    // diffused_wavefunction(queries->config(n), tau, n).
+    //
+    // The squared distances between a block of walkers and every query
+    // are evaluated as |x|^2 + |y|^2 - 2 x.y, where the x.y are a dense
+    // matrix product with the walkers stored as [coordinate][walker].
+    // The block of walkers stays in cache whilst the queries stream by.
+    scoped_timer timer(PHASE_PSI_D);
+    const unsigned block = 256;
+    unsigned d  = walker::coord_count();
+    unsigned nw = size();
+    unsigned nq = queries->size();
+    psi_d_evaluations += nq;
+
+    // Precompute the norms, transposed configurations and
+    // positive/negative parts of the weights of the walkers
+    std::vector<double> y_t(d*nw);
+    std::vector<double> y_norm(nw);
+    std::vector<double> w_pos(nw);
+    std::vector<double> w_neg(nw);
+    for (unsigned n=0; n<nw; ++n)
+    {
+        double* y = config(n);
+        y_norm[n] = 0;
+        for (unsigned j=0; j<d; ++j)
+        {
+            y_t[j*nw+n] = y[j];
+            y_norm[n]  += y[j]*y[j];
+        }
+        w_pos[n] = weights[n] > 0 ?  weights[n] : 0;
+        w_neg[n] = weights[n] < 0 ? -weights[n] : 0;
     }
-    return ret;
+
+    std::vector<double> x_norm(nq);
+    for (unsigned q=0; q<nq; ++q)
+    {
+        double* x = queries->config(q);
+        x_norm[q] = 0;
+        for (unsigned j=0; j<d; ++j)
+            x_norm[q] += x[j]*x[j];
+    }
+
+    psi.assign(2*nq, 0);
+    for (unsigned n0=0; n0<nw; n0+=block)
+    {
+        unsigned nb = std::min(block, nw-n0);
+
+        #pragma omp parallel for schedule(static)
+        for (unsigned q=0; q<nq; ++q)
+        {
+            double  r2[block];
+            double* x = queries->config(q);
+            for (unsigned i=0; i<nb; ++i)
+                r2[i] = x_norm[q] + y_norm[n0+i];
+            for (unsigned j=0; j<d; ++j)
+            {
+                double  xj = 2*x[j];
+                double* yj = &y_t[j*nw+n0];
+                for (unsigned i=0; i<nb; ++i)
+                    r2[i] -= xj * yj[i];
+            }
+
+            // (r2 can be slightly negative due to rounding)
+            for (unsigned i=0; i<nb; ++i)
+                r2[i] = -std::max(r2[i], 0.0)/(2*tau);
+            fexp(r2, nb);
+
+            double pos = 0;
+            double neg = 0;
+            for (unsigned i=0; i<nb; ++i)
+            {
+                pos += w_pos[n0+i] * r2[i];
+                neg += w_neg[n0+i] * r2[i];
+            }
+
+            // Treat walkers own contributions differently (using
+            // the greens function summed above, so that it cancels)
+            if (q >= n0 && q < n0+nb && params::self_gf_strength != 1.0)
+            {
+                double self = 1.0 - params::self_gf_strength;
+                pos -= self * w_pos[q] * r2[q-n0];
+                neg -= self * w_neg[q] * r2[q-n0];
+            }
+            psi[2*q]   += pos;
+            psi[2*q+1] += neg;
+        }
+    }
+
+    // Normalize the greens function
+    double norm = sqrt(2*PI*tau);
+    for (unsigned q=0; q<nq; ++q)
+    {
+        psi[2*q]   /= norm;
+        psi[2*q+1] /= norm;
+    }
+}
+
+// The diffused wavefunction kernels specialised to the number of dimensions
+// (use the generic kernels until select_kernels is called)
+double (walker_collection::*walker_collection::psi_d_kernel)(double*, double, int)
+    = &walker_collection::diffused_wavefunction<0>;
+void (walker_collection::*walker_collection::psi_d_signed_kernel)(double*, double, double*, double, int)
+    = &walker_collection::diffused_wavefunction_signed<0>;
+double (walker_collection::*walker_collection::nearest_opposite_kernel)(double*, double)
+    = &walker_collection::distance_to_nearest_opposite<0>;
+
+void walker_collection :: select_kernels()
+{
+    // Select the kernels specialised to the
+    // number of dimensions that we are using
+    walker::select_kernels();
+    switch(params::dimensions)
+    {
+        case 1:
+            psi_d_kernel            = &walker_collection::diffused_wavefunction<1>;
+            psi_d_signed_kernel     = &walker_collection::diffused_wavefunction_signed<1>;
+            nearest_opposite_kernel = &walker_collection::distance_to_nearest_opposite<1>;
+            break;
+        case 2:
+            psi_d_kernel            = &walker_collection::diffused_wavefunction<2>;
+            psi_d_signed_kernel     = &walker_collection::diffused_wavefunction_signed<2>;
+            nearest_opposite_kernel = &walker_collection::distance_to_nearest_opposite<2>;
+            break;
+        case 3:
+            psi_d_kernel            = &walker_collection::diffused_wavefunction<3>;
+            psi_d_signed_kernel     = &walker_collection::diffused_wavefunction_signed<3>;
+            nearest_opposite_kernel = &walker_collection::distance_to_nearest_opposite<3>;
+            break;
+        default:
+            psi_d_kernel            = &walker_collection::diffused_wavefunction<0>;
+            psi_d_signed_kernel     = &walker_collection::diffused_wavefunction_signed<0>;
+            nearest_opposite_kernel = &walker_collection::distance_to_nearest_opposite<0>;
+    }
+}
+
+unsigned long long walker_collection :: psi_d_evaluations = 0;
+
+double walker_collection :: diffused_wavefunction(
+    double* x, double tau=params::tau, int self_index=-1)
+{
+    #pragma omp atomic
+    psi_d_evaluations += 1;
+    return (this->*psi_d_kernel)(x, tau, self_index);
+}
+
+void walker_collection :: diffused_wavefunction_signed(
+    double* x, double weight, double* ret, double tau=params::tau, int self_index=-1)
+{
+    #pragma omp atomic
+    psi_d_evaluations += 1;
+    (this->*psi_d_signed_kernel)(x, weight, ret, tau, self_index);
 }
 
-double* walker_collection :: exchange_diffused_wfn_signed(
-    walker* c, double tau=params::tau, int self_index=-1)
+void walker_collection :: exchange_diffused_wfn_signed(
+    double* x, double weight, double* ret, double tau=params::tau, int self_index=-1)
 {
     // Evaluate the exchange-diffused wavefunction as components whos sign
-    // matches c and those that do not
-    double* ret = new double[2];
+    // matches that of a walker at x with the given weight and those
+    // that do not
+    #pragma omp atomic
+    psi_d_evaluations += 1;
     ret[0] = 0; // Same sign
     ret[1] = 0; // Opposite sign
-    for (unsigned n=0; n < walkers.size(); ++n)
+    for (unsigned n=0; n < size(); ++n)
     {
-        walker* w  = walkers[n];
-
         // Treat my own contribution to the
         // greens function differently
         double  amp = 1.0;
         if (int(n) == self_index) 
             amp = params::self_gf_strength;
 
-        double* gf = w->exchange_diffusive_gf(c, tau);
-        gf[0]     *= amp*fabs(w->weight);
-        gf[1]     *= amp*fabs(w->weight);
+        double gf[2];
+        walker::exchange_diffusive_gf(config(n), x, tau, gf);
+        gf[0]     *= amp*fabs(weights[n]);
+        gf[1]     *= amp*fabs(weights[n]);
 
-        if (sign(w->weight/c->weight) == 1)
+        if (sign(weights[n]/weight) == 1)
         {
-            // w and c are same sign =>
+            // The n^th walker and x are same sign =>
             // gf[0] is same-sign contribution
             // gf[1] is opposite-sign contribution
             ret[0] += gf[0];
@@ -223,17 +635,54 @@ double* walker_collection :: exchange_diffused_wfn_signed(
         }
         else
         {
-            // w and c are opposite signs =>
+            // The n^th walker and x are opposite signs =>
             // gf[0] is opposite-sign contribution
             // gf[1] is same-sign contribution
             ret[0] += gf[1]; 
             ret[1] += gf[0];
         }
+    }
+}
+
+double walker_collection :: exchange_diffused_wfn(
+    double* x, double weight, double tau=params::tau, int self_index=-1)
+{
+    // Evaluate the exchange-diffused wavefunction at x, signed such that
+    // it is positive if it has the same sign as a walker at x with the
+    // given weight (i.e ret[0] - ret[1] from exchange_diffused_wfn_signed)
+    #pragma omp atomic
+    psi_d_evaluations += 1;
+    double psi = 0;
+    for (unsigned n=0; n < size(); ++n)
+    {
+        double  amp = 1.0;
+        if (int(n) == self_index)
+            amp = params::self_gf_strength;
+
+        double gf = amp * fabs(weights[n]) *
+                    walker::exchange_diffusive_gf(config(n), x, tau);
+        psi += sign(weights[n]/weight) == 1 ? gf : -gf;
+    }
+    return psi;
+}
 
-        // Free memory
-        delete[] gf;
+void diffuse_blocks(double* x_from, double* x_to, unsigned count, double tau)
+{
+    // Diffuse the count configurations in x_from into x_to, split into
+    // one contiguous block per thread (in thread order, so that each
+    // thread's random stream always diffuses the same block and the
+    // result is reproducible for a given number of threads)
+    unsigned threads = params::threads;
+    unsigned cc      = walker::coord_count();
+
+    #pragma omp parallel for schedule(static, 1)
+    for (unsigned t=0; t<threads; ++t)
+    {
+        unsigned begin = (unsigned long)count * t / threads;
+        unsigned end   = (unsigned long)count * (t+1) / threads;
+        if (end > begin)
+            walker::diffuse(x_from + begin*cc, x_to + begin*cc, end - begin, tau);
     }
-    return ret;
 }
 
 double potential_greens_function(double pot_before, double pot_after)
@@ -245,38 +694,34 @@ double potential_greens_function(double pot_before, double pot_after)
     return fexp( -params::tau * (pot_before + pot_after)/2.0 );
 }
 
-void walker_collection :: diffuse_exact_1d()
+void walker_collection :: diffuse_exact_1d(walker_collection* walkers_last)
 {
     // Error if dimensions of system != 1
     if (params::dimensions != 1)
         throw "Dimension != 1 in exact 1d diffusion!";
 
     // Carry out diffusion of the walkers
-    for (unsigned n=0; n < walkers.size(); ++n)
+    for (unsigned n=0; n < size(); ++n)
     {
-        // Diffuse the walker
-        walker* w = walkers[n];
-        walker* w_before = w->copy();
-        w->diffuse(params::tau);
+        double* x        = config(n);
+        double* x_before = walkers_last->config(n);
 
         // Kill walkers crossing the nodal surface
-        if (w_before->crossed_nodal_surface(w))
+        if (walker::crossed_nodal_surface(x_before, x))
         {
             // Record the nodal surface
             if (params::write_nodal_surface)
-                w->write_coords(params::nodal_surface_file);
+                walker::write_coords(params::nodal_surface_file, weights[n], x);
 
             // Kill the walker
-            w->weight = 0;
+            weights[n] = 0;
             params::cancelled_weight += 1;
         }
 
         // Apply potential part of greens function
-        double pot_before = w_before->potential();
-        double pot_after  = w->potential();
-        w->weight        *= potential_greens_function(pot_before, pot_after);
-
-        delete w_before;
+        double pot_before = walkers_last->potential(n);
+        double pot_after  = potential(n);
+        weights[n]       *= potential_greens_function(pot_before, pot_after);
     }
 }
 
@@ -285,15 +730,12 @@ void walker_collection :: diffuse_bosonic(walker_collection* walkers_last)
     // Carry out normal bosonic DMC diffusion
     // where each walker diffuses independently
     // according to the diffusive greens function
-    for (unsigned n=0; n < walkers.size(); ++n)
+    for (unsigned n=0; n < size(); ++n)
     {
-        walker* w = walkers[n];
-        w->diffuse(params::tau);
-
         // Apply potential part of greens function
-        double pot_before = walkers_last->walkers[n]->potential();
-        double pot_after  = w->potential();
-        w->weight        *= potential_greens_function(pot_before, pot_after);
+        double pot_before = walkers_last->potential(n);
+        double pot_after  = potential(n);
+        weights[n]       *= potential_greens_function(pot_before, pot_after);
     }
 }
 
@@ -302,254 +744,382 @@ void walker_collection :: diffuse_max_seperation(walker_collection* walkers_last
     // Carry out diffusion of the walkers in a manner
     // that will result in the maximum seperation of 
     // +ve wlakers to -ve walkers.
-    for (unsigned n=0; n < walkers.size(); ++n)
+    // Evaluate the components of the wavefunction with the same
+    // sign as each walker (psi[2n]) and the opposite sign (psi[2n+1])
+    std::vector<double> psi(2*size());
+    std::vector<double> psi_nodes(2*size());
+    if (params::psi_d_engine == "batched")
+    {
+        walkers_last->diffused_wavefunction_batch(this, params::tau, psi);
+        walkers_last->diffused_wavefunction_batch(this, params::tau_nodes, psi_nodes);
+        for (unsigned n=0; n < size(); ++n)
+            if (weights[n] < 0)
+            {
+                std::swap(psi[2*n], psi[2*n+1]);
+                std::swap(psi_nodes[2*n], psi_nodes[2*n+1]);
+            }
+    }
+    else
+    {
+        walkers_last->transform(params::tau);
+        walkers_last->transform(params::tau_nodes);
+
+        scoped_timer timer(PHASE_PSI_D);
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (unsigned n=0; n < size(); ++n)
+        {
+            walkers_last->diffused_wavefunction_signed(
+                config(n), weights[n], &psi[2*n], params::tau, int(n));
+            walkers_last->diffused_wavefunction_signed(
+                config(n), weights[n], &psi_nodes[2*n], params::tau_nodes, int(n));
+        }
+    }
+
+    for (unsigned n=0; n < size(); ++n)
     {
-        walker* w = walkers[n];
-        w->diffuse(params::tau);
-        double* psi = walkers_last->diffused_wavefunction_signed(w, params::tau, int(n));
-        double* psi_nodes = walkers_last->diffused_wavefunction_signed(w, params::tau_nodes, int(n));
+        double same     = psi[2*n];
+        double opposite = psi[2*n+1];
 
-        if (psi[0] < psi[1] || psi_nodes[0] < psi_nodes[1])
+        if (same < opposite || psi_nodes[2*n] < psi_nodes[2*n+1])
         {
             // Record the nodal surface
             if (params::write_nodal_surface)
-                w->write_coords(params::nodal_surface_file);
+                walker::write_coords(params::nodal_surface_file, weights[n], config(n));
 
-            // w has strayed into the wrong neighbourhood, kill them
-            w->weight = 0;
+            // The walker has strayed into the wrong neighbourhood, kill it
+            weights[n] = 0;
             params::cancelled_weight += 1;
         }
         else
         {
             // Account for cancellations
-            params::cancelled_weight += fabs(w->weight * psi[1]/psi[0]);
-            w->weight *= 1 - psi[1]/psi[0];
+            params::cancelled_weight += fabs(weights[n] * opposite/same);
+            weights[n] *= 1 - opposite/same;
         }
 
-        // Free memory
-        delete[] psi;
-        delete[] psi_nodes;
-
         // Apply potential part of greens function
-        double pot_before = walkers_last->walkers[n]->potential();
-        double pot_after  = w->potential();
-        w->weight        *= potential_greens_function(pot_before, pot_after);
+        double pot_before = walkers_last->potential(n);
+        double pot_after  = potential(n);
+        weights[n]       *= potential_greens_function(pot_before, pot_after);
     }
 }
 
 void walker_collection :: diffuse_max_seperation_mpi(walker_collection* walkers_last)
 {
+    mpi_call_site site("diffuse_max_seperation_mpi");
+
     // Carry out diffusion of walkers, evaluating a stochastic nodal
-    // surface using all the walkers across processes
+    // surface using all the walkers across processes.
+    //
+    // The blocks of walkers_last on each process are passed around
+    // a ring of processes; whilst each block is being sent on to the
+    // next process (and the following block recieved from the last),
+    // it's contributions to the wavefunction at my walkers are summed.
+    // After np steps every block has visited every process, but each
+    // process only ever holds two of them at once.
+    unsigned cc   = walker::coord_count();
+    int      next = (params::pid + 1) % params::np;
+    int      last = (params::pid + params::np - 1) % params::np;
+
+    // Get the number of walkers in each block
+    std::vector<int> block_sizes(params::np);
+    int my_size = int(walkers_last->size());
+    {
+        scoped_timer timer(PHASE_MPI_WAIT);
+        MPI_Allgather(&my_size, 1, MPI_INT, &block_sizes[0], 1, MPI_INT, MPI_COMM_WORLD);
+    }
 
-    // Loop over processes
-    for (int pid=0; pid<params::np; ++pid)
+    // The components of the wavefunction at each of my walkers with
+    // the same sign as the walker (psi[2n]) and the opposite sign (psi[2n+1])
+    std::vector<double> psi(2*size(), 0.0);
+
+    walker_collection buffer_a(nullptr);
+    walker_collection buffer_b(nullptr);
+    walker_collection* buffers[2] = {&buffer_a, &buffer_b};
+    walker_collection* block = walkers_last;
+    for (int step=0; step<params::np; ++step)
     {
-        // Get the number of walkers on this process
-        int walker_count = params::pid == pid ? walkers.size() : 0;
-        MPI_Bcast(&walker_count, 1, MPI_INT, pid, MPI_COMM_WORLD);
-        
-        // Propagate the walkers on this process
-        for (int n=0; n<walker_count; ++n)
+        // Start passing this block on, and recieving the next
+        MPI_Request requests[4];
+        int request_count = 0;
+        walker_collection* incoming = buffers[step % 2];
+        if (step < params::np - 1)
         {
-            // w is the n^th walker on the pid^th process
-            walker* w = params::pid == pid ? walkers[n] : nullptr;
-
-            // On the pid^th process, diffuse the walker
-            if (params::pid == pid)
-                w->diffuse(params::tau);
-
-            // Get a copy of the n^th walker on the 
-            // pid^th process, after diffusion.
-            // (the copy will be valid on all processes)
-            walker* w_after = walker::mpi_copy(w, pid);
-
-            // Compute the across-process wavefunction after diffusion
-            double* psi_after_pid = walkers_last->
-                diffused_wavefunction_signed(w_after, params::tau_nodes, -1);
-            double* psi_after = new double[2];
-            MPI_Reduce(psi_after_pid, psi_after, 2, MPI_DOUBLE, MPI_SUM, pid, MPI_COMM_WORLD);
-
-            // On the pid^th process, apply the cancellation function
-            // w -> w * f_+/-
-            if (params::pid == pid)
+            int from = (params::pid + params::np - step - 1) % params::np;
+            unsigned incoming_size = block_sizes[from];
+            incoming->coords.resize(incoming_size*cc);
+            incoming->weights.resize(incoming_size);
+
+            MPI_Irecv(incoming->coords.data(), incoming_size*cc, MPI_DOUBLE, last, 0,
+                      MPI_COMM_WORLD, &requests[request_count++]);
+            MPI_Irecv(incoming->weights.data(), incoming_size, MPI_DOUBLE, last, 1,
+                      MPI_COMM_WORLD, &requests[request_count++]);
+            MPI_Isend(block->coords.data(), block->size()*cc, MPI_DOUBLE, next, 0,
+                      MPI_COMM_WORLD, &requests[request_count++]);
+            MPI_Isend(block->weights.data(), block->size(), MPI_DOUBLE, next, 1,
+                      MPI_COMM_WORLD, &requests[request_count++]);
+        }
+
+        // Add the contributions of this block (walkers_last
+        // is already indexed, recieved blocks need indexing)
+        if (block != walkers_last) block->build_index();
+        block->transform(params::tau_nodes);
+
+        {
+            scoped_timer timer(PHASE_PSI_D);
+            #pragma omp parallel for schedule(dynamic, 16)
+            for (unsigned n=0; n < size(); ++n)
             {
-                if (psi_after[0] < psi_after[1])
-                {
-                    // Record the nodal surface
-                    if (params::write_nodal_surface)
-                        w->write_coords(params::nodal_surface_file);
-
-                    // Kill the walker
-                    w->weight = 0;
-                    params::cancelled_weight += 1;
-                }
-                else
-                {
-                    params::cancelled_weight += fabs(w->weight * psi_after[1]/psi_after[0]);
-                    w->weight *= 1 - psi_after[1]/psi_after[0];
-                }
+                double psi_block[2];
+                block->diffused_wavefunction_signed(
+                    config(n), weights[n], psi_block, params::tau_nodes, -1);
+                psi[2*n]   += psi_block[0];
+                psi[2*n+1] += psi_block[1];
             }
+        }
 
-            // Free memory
-            delete w_after;
-            delete[] psi_after_pid;
-            delete[] psi_after;
+        // Wait for the next block to arrive
+        {
+            scoped_timer timer(PHASE_MPI_WAIT);
+            MPI_Waitall(request_count, requests, MPI_STATUSES_IGNORE);
+        }
+        block = incoming;
+    }
+
+    // Apply the cancellation function w -> w * f_+/-
+    for (unsigned n=0; n < size(); ++n)
+    {
+        if (psi[2*n] < psi[2*n+1])
+        {
+            // Record the nodal surface
+            if (params::write_nodal_surface)
+                walker::write_coords(params::nodal_surface_file, weights[n], config(n));
+
+            // Kill the walker
+            weights[n] = 0;
+            params::cancelled_weight += 1;
+        }
+        else
+        {
+            params::cancelled_weight += fabs(weights[n] * psi[2*n+1]/psi[2*n]);
+            weights[n] *= 1 - psi[2*n+1]/psi[2*n];
         }
     }
 
     // Apply the potential part of the greens function
     // (which is independent of the other processes)
-    for (unsigned n=0; n < walkers.size(); ++n)
+    for (unsigned n=0; n < size(); ++n)
     {
-        double pot_before   = walkers_last->walkers[n]->potential();
-        double pot_after    = walkers[n]->potential();
-        walkers[n]->weight *= potential_greens_function(pot_before, pot_after);
+        double pot_before = walkers_last->potential(n);
+        double pot_after  = potential(n);
+        weights[n]       *= potential_greens_function(pot_before, pot_after);
     }
 }
 
-
 void walker_collection :: exchange_diffuse(walker_collection* walkers_last)
 {
     // Carry out diffusion of the walkers in a manner
     // that will result in the maximum seperation of 
     // +ve walkers to -ve walkers, taking into account
     // the exchanged images of the walkers.
-    for (unsigned n=0; n < walkers.size(); ++n)
+    double cancelled = 0;
+
+    scoped_timer timer(PHASE_PSI_D);
+    #pragma omp parallel for schedule(dynamic, 16) reduction(+:cancelled)
+    for (unsigned n=0; n < size(); ++n)
     {
-        walker* w = walkers[n];
-        w->diffuse(params::tau);
-        double* psi = walkers_last->exchange_diffused_wfn_signed(w, params::tau, int(n));
+        double* x = config(n);
+
+        double psi[2];
+        walkers_last->exchange_diffused_wfn_signed(
+            x, weights[n], psi, params::tau, int(n));
 
         if (psi[0] < psi[1])
         {
-            // w has strayed into the wrong neighbourhood, kill them
+            // The walker has strayed into the wrong neighbourhood, kill it
 
             // Record the nodal surface
             if (params::write_nodal_surface)
-                w->write_coords(params::nodal_surface_file);
+            {
+                #pragma omp critical(nodal_surface)
+                walker::write_coords(params::nodal_surface_file, weights[n], x);
+            }
 
             // Kill the walker
-            w->weight = 0;
-            params::cancelled_weight += 1;
+            weights[n] = 0;
+            cancelled += 1;
         }
         else
         {
             // Account for cancellations
-            params::cancelled_weight += fabs(w->weight * psi[1]/psi[0]);
-            w->weight *= 1 - psi[1]/psi[0];
+            cancelled  += fabs(weights[n] * psi[1]/psi[0]);
+            weights[n] *= 1 - psi[1]/psi[0];
         }
 
-        // Free memory
-        delete psi;
-
         // Apply potential part of greens function
-        double pot_before = walkers_last->walkers[n]->potential();
-        double pot_after  = w->potential();
-        w->weight        *= potential_greens_function(pot_before, pot_after);
+        double pot_before = walkers_last->potential(n);
+        double pot_after  = potential(n);
+        weights[n]       *= potential_greens_function(pot_before, pot_after);
     }
+    params::cancelled_weight += cancelled;
 }
 
 void walker_collection :: diffuse_stochastic_nodes(walker_collection* walkers_last)
 {
     // Carry out diffusion of walkers, killing any that cross the
     // stochastic nodal surface set up last iteration
-    for (unsigned n=0; n < walkers.size(); ++n)
-    {
-        walker* w = walkers[n];
+    std::vector<double> psi_before(size());
+    std::vector<double> psi_after(size());
+    std::vector<double> psi(2*size());
+    bool batched = params::psi_d_engine == "batched";
 
-        double psi_before = walkers_last->
-            diffused_wavefunction(w, params::tau_nodes, int(n));
+    // Evaluate the wavefunction before diffusion
+    if (batched)
+    {
+        walkers_last->diffused_wavefunction_batch(walkers_last, params::tau_nodes, psi);
+        for (unsigned n=0; n < size(); ++n)
+            psi_before[n] = psi[2*n] - psi[2*n+1];
+    }
+    else
+    {
+        walkers_last->transform(params::tau_nodes);
 
-        w->diffuse(params::tau);
+        scoped_timer timer(PHASE_PSI_D);
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (unsigned n=0; n < size(); ++n)
+            psi_before[n] = walkers_last->
+                diffused_wavefunction(walkers_last->config(n), params::tau_nodes, int(n));
+    }
 
-        double psi_after  = walkers_last->
-            diffused_wavefunction(w, params::tau_nodes, int(n));
+    // Evaluate the wavefunction after diffusion
+    if (batched)
+    {
+        walkers_last->diffused_wavefunction_batch(this, params::tau_nodes, psi);
+        for (unsigned n=0; n < size(); ++n)
+            psi_after[n] = psi[2*n] - psi[2*n+1];
+    }
+    else
+    {
+        scoped_timer timer(PHASE_PSI_D);
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (unsigned n=0; n < size(); ++n)
+            psi_after[n] = walkers_last->
+                diffused_wavefunction(config(n), params::tau_nodes, int(n));
+    }
 
-        if (sign(psi_before) != sign(psi_after))
+    for (unsigned n=0; n < size(); ++n)
+    {
+        if (sign(psi_before[n]) != sign(psi_after[n]))
         {
             // Record the nodal surface
             if (params::write_nodal_surface)
-                w->write_coords(params::nodal_surface_file);
+                walker::write_coords(params::nodal_surface_file, weights[n], config(n));
 
-            // w has strayed into the wrong neighbourhood, kill them
-            w->weight = 0;
+            // The walker has strayed into the wrong neighbourhood, kill it
+            weights[n] = 0;
             params::cancelled_weight += 1;
         }
 
         // Apply potential part of greens function
-        double pot_before = walkers_last->walkers[n]->potential();
-        double pot_after  = w->potential();
-        w->weight        *= potential_greens_function(pot_before, pot_after);
+        double pot_before = walkers_last->potential(n);
+        double pot_after  = potential(n);
+        weights[n]       *= potential_greens_function(pot_before, pot_after);
     }
 }
 
 void walker_collection :: diffuse_stochastic_nodes_mpi(walker_collection* walkers_last)
 {
+    mpi_call_site site("diffuse_stochastic_nodes_mpi");
+
     // Carry out diffusion of walkers, evaluating a stochastic nodal
-    // surface using all the walkers across processes
+    // surface using all the walkers across processes.
+    //
+    // The configurations of every walker before and after diffusion
+    // are gathered onto every process in a single collective, each
+    // process sums the contributions of it's own walkers to the
+    // wavefunction at all of them, and a single reduce-scatter
+    // returns the totals to the process that owns each walker.
+    unsigned cc = walker::coord_count();
+    unsigned nl = size();
+
+    // Get the number of walkers on each process
+    std::vector<int> walker_counts(params::np);
+    int my_count = int(nl);
+    {
+        scoped_timer timer(PHASE_MPI_WAIT);
+        MPI_Allgather(&my_count, 1, MPI_INT, &walker_counts[0], 1, MPI_INT, MPI_COMM_WORLD);
+    }
 
-    // Loop over processes
+    // Gather the configurations, packed as [process][before/after][walker][coord]
+    std::vector<int> config_counts(params::np);
+    std::vector<int> config_displs(params::np);
+    std::vector<int> psi_counts(params::np);
+    unsigned total = 0;
     for (int pid=0; pid<params::np; ++pid)
     {
-        // Get the number of walkers on this process
-        int walker_count = params::pid == pid ? walkers.size() : 0;
-        MPI_Bcast(&walker_count, 1, MPI_INT, pid, MPI_COMM_WORLD);
-        
-        // Propagate the walkers on this process
-        for (int n=0; n<walker_count; ++n)
+        config_counts[pid] = 2 * walker_counts[pid] * cc;
+        config_displs[pid] = 2 * total * cc;
+        psi_counts[pid]    = 2 * walker_counts[pid];
+        total += walker_counts[pid];
+    }
+
+    std::vector<double> local_configs(2*nl*cc + 1);
+    for (unsigned i=0; i<nl*cc; ++i)
+    {
+        local_configs[i]         = walkers_last->coords[i];
+        local_configs[nl*cc + i] = coords[i];
+    }
+
+    std::vector<double> all_configs(2*total*cc + 1);
+    {
+        scoped_timer timer(PHASE_MPI_WAIT);
+        MPI_Allgatherv(&local_configs[0], 2*nl*cc, MPI_DOUBLE,
+                       &all_configs[0], &config_counts[0], &config_displs[0],
+                       MPI_DOUBLE, MPI_COMM_WORLD);
+    }
+
+    // Evaluate the contributions of the walkers on this
+    // process to the wavefunction at every configuration
+    std::vector<double> psi_partial(2*total + 1);
+    walkers_last->transform(params::tau_nodes);
+
+    {
+        scoped_timer timer(PHASE_PSI_D);
+        #pragma omp parallel for schedule(dynamic, 16)
+        for (unsigned q=0; q<2*total; ++q)
+            psi_partial[q] = walkers_last->
+                diffused_wavefunction(&all_configs[q*cc], params::tau_nodes, -1);
+    }
+
+    // Sum the contributions across processes, returning the wavefunction
+    // before (psi[n]) and after (psi[nl+n]) diffusion of my walkers
+    std::vector<double> psi(2*nl + 1);
+    {
+        scoped_timer timer(PHASE_MPI_WAIT);
+        MPI_Reduce_scatter(&psi_partial[0], &psi[0], &psi_counts[0],
+                           MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    }
+
+    // Kill walkers that crossed the nodal surface
+    for (unsigned n=0; n < nl; ++n)
+        if (sign(psi[n]) != sign(psi[nl+n]))
         {
-            // Get a copy of the i^th walker on the 
-            // pid^th process, before diffusion
-            walker* w = params::pid == pid ? walkers[n] : nullptr;
-            walker* w_before = walker::mpi_copy(w, pid);
-
-            // Compute the across-process wavefunction before diffusion
-            double psi_before_pid = walkers_last->
-                diffused_wavefunction(w_before, params::tau_nodes, -1); 
-            double psi_before;
-            MPI_Reduce(&psi_before_pid, &psi_before, 1, MPI_DOUBLE, MPI_SUM, pid, MPI_COMM_WORLD);
-
-            // On the pid^th process, diffuse the walker
-            if (params::pid == pid)
-                w->diffuse(params::tau);
-
-            // Get a copy of the i^th walker on the 
-            // pid^th process, after diffusion
-            walker* w_after = walker::mpi_copy(w, pid);
-
-            // Compute the across-process wavefunction after diffusion
-            double psi_after_pid = walkers_last->
-                diffused_wavefunction(w_after, params::tau_nodes, -1);
-            double psi_after;
-            MPI_Reduce(&psi_after_pid, &psi_after, 1, MPI_DOUBLE, MPI_SUM, pid, MPI_COMM_WORLD);
-
-            // On the pid^th process, kill the walker if it crossed the nodal surface
-            if (params::pid == pid)
-                if (sign(psi_before) != sign(psi_after))
-                {
-                    // Record the nodal surface
-                    if (params::write_nodal_surface)
-                        w->write_coords(params::nodal_surface_file);
-
-                    // Kill the walker
-                    w->weight = 0;
-                    params::cancelled_weight += 1;
-                }
-
-            // Free memory
-            delete w_before;
-            delete w_after;
+            // Record the nodal surface
+            if (params::write_nodal_surface)
+                walker::write_coords(params::nodal_surface_file, weights[n], config(n));
+
+            // Kill the walker
+            weights[n] = 0;
+            params::cancelled_weight += 1;
         }
-    }
 
     // Apply the potential part of the greens function
     // (which is independent of the other processes)
-    for (unsigned n=0; n < walkers.size(); ++n)
+    for (unsigned n=0; n < size(); ++n)
     {
-        double pot_before   = walkers_last->walkers[n]->potential();
-        double pot_after    = walkers[n]->potential();
-        walkers[n]->weight *= potential_greens_function(pot_before, pot_after);
+        double pot_before = walkers_last->potential(n);
+        double pot_after  = potential(n);
+        weights[n]       *= potential_greens_function(pot_before, pot_after);
     }
 }
 
@@ -557,49 +1127,60 @@ void walker_collection :: diffuse_stochastic_nodes_permutations(walker_collectio
 {
     // Carry out diffusion of walkers, killing any that cross the
     // stochastic nodal surface set up last iteration
-    for (unsigned n=0; n < walkers.size(); ++n)
-    {
-        walker* w = walkers[n];
+    double cancelled = 0;
 
-        w->diffuse(params::tau);
+    scoped_timer timer(PHASE_PSI_D);
+    #pragma omp parallel for schedule(dynamic, 16) reduction(+:cancelled)
+    for (unsigned n=0; n < size(); ++n)
+    {
+        double* x = config(n);
 
-        double* psi_after  = walkers_last->
-            exchange_diffused_wfn_signed(w, params::tau_nodes, int(n));
+        double psi_after = walkers_last->exchange_diffused_wfn(
+            x, weights[n], params::tau_nodes, int(n));
 
-        if (psi_after[0] < psi_after[1])
+        if (psi_after < 0)
         {
             // Record the nodal surface
             if (params::write_nodal_surface)
-                w->write_coords(params::nodal_surface_file);
+            {
+                #pragma omp critical(nodal_surface)
+                walker::write_coords(params::nodal_surface_file, weights[n], x);
+            }
 
-            // w has strayed into the wrong neighbourhood, kill them
-            w->weight = 0;
-            params::cancelled_weight += 1;
+            // The walker has strayed into the wrong neighbourhood, kill it
+            weights[n] = 0;
+            cancelled += 1;
         }
 
-        delete[] psi_after;
-
         // Apply potential part of greens function
-        double pot_before = walkers_last->walkers[n]->potential();
-        double pot_after  = w->potential();
-        w->weight        *= potential_greens_function(pot_before, pot_after);
+        double pot_before = walkers_last->potential(n);
+        double pot_after  = potential(n);
+        weights[n]       *= potential_greens_function(pot_before, pot_after);
     }
+    params::cancelled_weight += cancelled;
+}
+
+double walker_collection :: distance_to_nearest_opposite(double* x, double weight)
+{
+    return (this->*nearest_opposite_kernel)(x, weight);
 }
 
-double walker_collection :: distance_to_nearest_opposite(walker* w)
+template<unsigned D>
+double walker_collection :: distance_to_nearest_opposite(double* x, double weight)
 {
     double min_dis = -1;
 
-    // Returns the distance to the nearest walker in
-    // this collection to w, which has opposite sign to w
-    for (unsigned n=0; n < walkers.size(); ++n)
+    // Returns the distance to the nearest walker in this 
+    // collection to a walker at x with the given weight,
+    // which has opposite sign to that walker
+    for (unsigned n=0; n < size(); ++n)
     {
         // These walkers are the same sign
-        if (sign(walkers[n]->weight) == sign(w->weight))
+        if (sign(weights[n]) == sign(weight))
             continue;
 
         // Record the distnace if this is the closest so far
-        double dis = w->sq_distance_to(walkers[n]);
+        double dis = walker::sq_distance<D>(x, config(n));
         if (min_dis < 0 || dis < min_dis)
             min_dis = dis;
     }
@@ -609,36 +1190,36 @@ double walker_collection :: distance_to_nearest_opposite(walker* w)
 
 double walker_collection :: tau_nodes_min_sep_mpi()
 {
+    mpi_call_site site("tau_nodes_min_sep_mpi");
+
     // Estimate tau_nodes from the minimum seperation
     // between any +ve and any -ve walker
     double average_min_dis = 0;
     int population = 0;
+    walker w_copy;
 
     // Loop over processes
     for (int pid=0; pid<params::np; ++pid)
     {
         // Get the number of walkers on this process
-        int walker_count = params::pid == pid ? walkers.size() : 0;
+        int walker_count = params::pid == pid ? size() : 0;
         MPI_Bcast(&walker_count, 1, MPI_INT, pid, MPI_COMM_WORLD);
         population += walker_count;
         
         // For each walker on process pid
         for (int n=0; n<walker_count; ++n)
         {
-            // Get a copy of the i^th walker on the pid^th process
-            walker* w = params::pid == pid ? walkers[n] : nullptr;
-            walker* w_copy = walker::mpi_copy(w, pid);
+            // Get a copy of the n^th walker on the pid^th process
+            mpi_copy(n, pid, &w_copy);
 
             // Get the minimum distance between w and any walker of the
             // opposite sign, across processes
-            double min_dis_this = distance_to_nearest_opposite(w_copy);
+            double min_dis_this = distance_to_nearest_opposite(w_copy.coords, w_copy.weight);
             double min_dis;
             MPI_Allreduce(&min_dis_this, &min_dis, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
 
             // Accumulate the average minimum-distance
             average_min_dis += min_dis;
-
-            delete w_copy;
         }
     }
 
@@ -649,18 +1230,17 @@ double walker_collection :: tau_nodes_min_sep()
 {
     double average_min_dis = 0;
 
-    for (unsigned n=0; n<walkers.size(); ++n)
-    {
-        walker* w = walkers[n];
-        average_min_dis += distance_to_nearest_opposite(w);
-    }
+    for (unsigned n=0; n<size(); ++n)
+        average_min_dis += distance_to_nearest_opposite(config(n), weights[n]);
 
-    average_min_dis /= double(walkers.size());
+    average_min_dis /= double(size());
     return average_min_dis / 2.0;
 }
 
 void walker_collection :: apply_renormalization()
 {
+    mpi_call_site site("apply_renormalization");
+
     // Apply the selected renormalization scheme
     // <=> energy estimator
     if (params::energy_estimator == "growth")
@@ -677,7 +1257,7 @@ void walker_collection :: apply_renormalization()
     else
         last_non_nan = params::trial_energy;
 
-    params::trial_energy = mpi_average(params::trial_energy);
+    // (the trial energy is averaged across processes in write_output)
 }
 
 unsigned target_population()
@@ -695,17 +1275,26 @@ unsigned target_population()
 
 void walker_collection :: renormalize_potential()
 {
+    // Sum the potential energy and the effective population
+    // across processes (in one reduction)
+    mpi_sums sums;
+    unsigned i_pot    = sums.add(average_potential());
+    unsigned i_pop    = sums.add(sum_mod_weight());
+    unsigned i_before = sums.add(double(size()));
+    sums.reduce();
+    params::growth_energy = log(sums.sum(i_before) / sums.sum(i_pop))/params::tau;
+
     // Set the trial energy with reference to the
     // potential energy
-    params::trial_energy = mpi_average(average_potential());
+    params::trial_energy = sums.average(i_pot);
 
     // Bias towards target population
-    params::trial_energy -= log(mpi_sum(sum_mod_weight()) / target_population());
+    params::trial_energy -= log(sums.sum(i_pop) / target_population());
 
     // Apply normalization greens function
     double gn = fexp(params::trial_energy * params::tau);
-    for (unsigned n=0; n<walkers.size(); ++n)
-        walkers[n]->weight *= gn;
+    for (unsigned n=0; n<size(); ++n)
+        weights[n] *= gn;
 }
 
 void walker_collection :: renormalize_growth()
@@ -715,16 +1304,20 @@ void walker_collection :: renormalize_growth()
     // target population. Do this by employing the 
     // growth estimator of the energy
 
-    // The population at the start of the iteration
-    double pop_before_propagation = mpi_sum(double(walkers.size()));
-
-    // The effective population now, after the cumulative
-    // effect of this iterations greens functions
-    // (i.e cancellation, diffusion, potential etc...)
-    double pop_after_propagation  = mpi_sum(sum_mod_weight());
+    // The population at the start of the iteration, and the
+    // effective population now, after the cumulative effect of
+    // this iterations greens functions (i.e cancellation,
+    // diffusion, potential etc...), summed in one reduction
+    mpi_sums sums;
+    unsigned i_before = sums.add(double(size()));
+    unsigned i_after  = sums.add(sum_mod_weight());
+    sums.reduce();
+    double pop_before_propagation = sums.sum(i_before);
+    double pop_after_propagation  = sums.sum(i_after);
 
     // Set trial energy to minimize fluctuations
     double new_trial_energy = log(pop_before_propagation / pop_after_propagation)/params::tau;
+    params::growth_energy   = new_trial_energy;
 
     // Bias towards target population
     new_trial_energy -= log(pop_before_propagation / target_population());
@@ -734,8 +1327,8 @@ void walker_collection :: renormalize_growth()
 
     // Apply normalization greens function
     double gn = fexp(params::trial_energy * params::tau);
-    for (unsigned n=0; n<walkers.size(); ++n)
-        walkers[n]->weight *= gn;
+    for (unsigned n=0; n<size(); ++n)
+        weights[n] *= gn;
 }
 
 int branch_from_weight(double weight)
@@ -747,30 +1340,30 @@ int branch_from_weight(double weight)
 
 void walker_collection :: branch()
 {
-    // Carry out branching of the walkers
-    unsigned nmax = walkers.size();
-    for (unsigned n=0; n < nmax; ++n)
+    // Carry out branching of the walkers, building the
+    // next generation from the branched survivors
+    walker_collection branched(nullptr);
+
+    // Exchange moves have been made since the potential was last
+    // evaluated, but only identical particles are exchanged so
+    // the cached potential is still valid for the survivors.
+    for (unsigned n=0; n < size(); ++n)
     {
-        walker* w = walkers[n];
-
-        // Apply branching step, adding branched
-        // survivors to the end of the collection
-        int surviving = branch_from_weight(w->weight);
+        // (weight is accounted for by the branching step,
+        //  the sign is all that continues)
+        int surviving = branch_from_weight(weights[n]);
         for (int s=0; s<surviving; ++s)
-            walkers.push_back(w->branch_copy());
+        {
+            branched.add(config(n), sign(weights[n]));
+            branched.potentials.back()      = potentials[n];
+            branched.potential_dirty.back() = potential_dirty[n];
+        }
     }
 
-    // Delete the previous iterations walkers
-    for (unsigned n=0; n < nmax; ++n)
-    {
-        // Replace the nth walker with the
-        // last walker, allowing us to shorten
-        // the array from the end (delete the
-        // nth walker in the process)
-        delete walkers[n];
-        walkers[n] = walkers.back();
-        walkers.pop_back();
-    }
+    // Replace the previous iterations walkers (the
+    // storage of which is recycled by the destructor
+    // of branched)
+    swap(&branched);
 }
 
 walker_collection :: walker_collection()
@@ -780,33 +1373,522 @@ walker_collection :: walker_collection()
 
     // Reserve a reasonable amount of space to deal efficiently
     // with the fact that the population can fluctuate.
-    walkers.reserve(2*int(per_process_pop));
+    double_pool.reserve(coords, per_process_pop*walker::coord_count());
+    double_pool.reserve(weights, per_process_pop);
+    double_pool.reserve(potentials, per_process_pop);
+    bool_pool.reserve(potential_dirty, per_process_pop);
 
     // Initialize the set of walkers to the target population size.
+    walker w;
     for (unsigned i=0; i<per_process_pop; ++i)
+        add(w.coords, 1.0);
+
+    // Pre-diffuse them, all in one batch
+    if (size() > 0)
+        diffuse_blocks(config(0), config(0), size(), params::pre_diffusion);
+    for (unsigned i=0; i<size(); ++i)
+        walker::reflect_to_irreducible(config(i));
+}
+
+walker_collection :: walker_collection(walker_collection* to_copy)
+{
+    // Create a collection using recycled storage,
+    // copying the walkers in to_copy (if not nullptr)
+    double_pool.acquire(coords);
+    double_pool.acquire(weights);
+    double_pool.acquire(potentials);
+    bool_pool.acquire(potential_dirty);
+    if (to_copy == nullptr) return;
+
+    double_pool.reserve(coords, to_copy->coords.size());
+    double_pool.reserve(weights, to_copy->size());
+    double_pool.reserve(potentials, to_copy->size());
+    bool_pool.reserve(potential_dirty, to_copy->size());
+
+    coords.assign(to_copy->coords.begin(), to_copy->coords.end());
+    weights.assign(to_copy->weights.begin(), to_copy->weights.end());
+    potentials.assign(to_copy->potentials.begin(), to_copy->potentials.end());
+    potential_dirty.assign(to_copy->potential_dirty.begin(), to_copy->potential_dirty.end());
+}
+
+walker_collection :: ~walker_collection()
+{
+    // Recycle the storage used by this collection
+    double_pool.release(coords);
+    double_pool.release(weights);
+    double_pool.release(potentials);
+    bool_pool.release(potential_dirty);
+}
+
+void walker_collection :: balance_load()
+{
+    mpi_call_site site("balance_load");
+
+    // Migrate walkers between processes so that each has the
+    // same number of walkers (to within one). Every process builds
+    // the same plan from the gathered populations, matching processes
+    // with too many walkers to those with too few in rank order, so
+    // that only the excess walkers are moved (the minimum possible).
+    std::vector<int> counts(params::np);
+    int my_count = int(size());
+    {
+        scoped_timer timer(PHASE_MPI_WAIT);
+        MPI_Allgather(&my_count, 1, MPI_INT, &counts[0], 1, MPI_INT, MPI_COMM_WORLD);
+    }
+
+    int total = 0;
+    int most  = 0;
+    for (int pid=0; pid<params::np; ++pid)
     {
-        walker* w = new walker();
-        w->diffuse(params::pre_diffusion);
-        w->reflect_to_irreducible();
-        walkers.push_back(w);
+        total += counts[pid];
+        most   = std::max(most, counts[pid]);
     }
+    params::load_imbalance   = total > 0 ? most * params::np / double(total) : 1.0;
+    params::walkers_migrated = 0;
+    if (!params::load_balance || params::np < 2) return;
+
+    // The excess (or deficit, if negative) of walkers on each process
+    std::vector<int> excess(params::np);
+    for (int pid=0; pid<params::np; ++pid)
+        excess[pid] = counts[pid] - (total / params::np + (pid < total % params::np ? 1 : 0));
+
+    // Walkers are packed as [coords, weight, potential, potential dirty]
+    unsigned cc     = walker::coord_count();
+    unsigned packed = cc + 3;
+
+    std::vector<MPI_Request> requests;
+    std::vector<std::vector<double>> buffers;
+    std::vector<unsigned> recieved_from;
+
+    // Match donors to recievers
+    int donor = 0;
+    int reciever = 0;
+    while (true)
+    {
+        while (donor < params::np && excess[donor] <= 0) ++donor;
+        while (reciever < params::np && excess[reciever] >= 0) ++reciever;
+        if (donor == params::np || reciever == params::np) break;
+
+        int moved = std::min(excess[donor], -excess[reciever]);
+        excess[donor]    -= moved;
+        excess[reciever] += moved;
+        params::walkers_migrated += moved;
+
+        if (params::pid == donor)
+        {
+            // Pack the walkers from the end of this collection
+            buffers.push_back(std::vector<double>(moved*packed));
+            double* buff = buffers.back().data();
+            for (int m=0; m<moved; ++m)
+            {
+                unsigned n = size() - 1;
+                double*  b = buff + m*packed;
+                double*  x = config(n);
+                for (unsigned j=0; j<cc; ++j) b[j] = x[j];
+                b[cc]   = weights[n];
+                b[cc+1] = potentials[n];
+                b[cc+2] = potential_dirty[n] ? 1.0 : 0.0;
+
+                coords.resize(n*cc);
+                weights.resize(n);
+                potentials.resize(n);
+                potential_dirty.resize(n);
+            }
+            requests.push_back(MPI_REQUEST_NULL);
+            MPI_Isend(buff, moved*packed, MPI_DOUBLE, reciever, 0, MPI_COMM_WORLD, &requests.back());
+        }
+        else if (params::pid == reciever)
+        {
+            buffers.push_back(std::vector<double>(moved*packed));
+            recieved_from.push_back(buffers.size() - 1);
+            requests.push_back(MPI_REQUEST_NULL);
+            MPI_Irecv(buffers.back().data(), moved*packed, MPI_DOUBLE, donor, 0,
+                      MPI_COMM_WORLD, &requests.back());
+        }
+    }
+
+    if (requests.empty()) return;
+    {
+        scoped_timer timer(PHASE_MPI_WAIT);
+        MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    }
+
+    // Add the walkers that we recieved
+    for (unsigned i : recieved_from)
+        for (unsigned b=0; b<buffers[i].size(); b+=packed)
+        {
+            double* w = &buffers[i][b];
+            add(w, w[cc]);
+            potentials.back()      = w[cc+1];
+            potential_dirty.back() = w[cc+2] != 0.0;
+        }
 }
 
-walker_collection :: ~walker_collection()
+// The header of a checkpoint file, which is followed by the state of
+// each random stream (as [process][thread]), the number of walkers
+// on each process, the size of the wavefunction file of each process,
+// the state passed to write_checkpoint and then the walkers, in order
+// of process, each stored as it's coordinates followed by it's weight
+struct checkpoint_header
+{
+    char     magic[8];
+    uint64_t iteration;
+    uint64_t walker_count;
+    uint64_t coord_count;
+    uint64_t process_count;
+    uint64_t stream_count;
+    uint64_t seed;
+    double   trial_energy;
+    double   tau_nodes;
+    uint64_t progress_size;
+    uint64_t evolution_size;
+    uint64_t state_count;
+    uint64_t stream_generation;
+};
+
+const char checkpoint_magic[8] = {'X', 'D', 'M', 'C', 'C', 'K', 'P', '3'};
+
+void walker_collection :: write_checkpoint(std::string filename, const std::vector<double>& state)
 {
-    // Clean up memory
-    for (unsigned n=0; n<walkers.size(); ++n)
-        delete walkers[n];
+    mpi_call_site site("write_checkpoint");
+
+    // Write the walkers on all processes, and everything else needed to
+    // continue the calculation, to a checkpoint file. This is collective;
+    // each process writes it's own walkers directly into the file with
+    // MPI-IO. The file is written under a temporary name and then
+    // renamed, so that the previous checkpoint survives a failed write.
+    // The sizes of the output files are recorded, so that a restart can
+    // cut them back to this point, along with state (e.g the estimates
+    // accumulated so far) on the root process.
+    unsigned cc      = walker::coord_count();
+    unsigned threads = params::threads;
+
+    // Work out where my walkers go
+    std::vector<uint64_t> counts(params::np);
+    uint64_t my_count = size();
+    MPI_Allgather(&my_count, 1, MPI_UINT64_T, &counts[0], 1, MPI_UINT64_T, MPI_COMM_WORLD);
+
+    // Write out the output so far, so that
+    // it is on disk before the checkpoint is
+    params::flush();
+    std::vector<uint64_t> output_sizes(params::np);
+    uint64_t my_output_size = params::wavefunction_file.size();
+    MPI_Gather(&my_output_size, 1, MPI_UINT64_T, &output_sizes[0], 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    uint64_t total  = 0;
+    uint64_t before = 0;
+    for (int pid=0; pid<params::np; ++pid)
+    {
+        if (pid < params::pid) before += counts[pid];
+        total += counts[pid];
+    }
+
+    // Collect the random streams of each of my threads
+    std::vector<random_stream> streams(threads);
+    #pragma omp parallel num_threads(threads)
+    streams[thread_id()] = rng;
+
+    // Pack my walkers
+    std::vector<double> packed(size()*(cc+1));
+    for (unsigned n=0; n<size(); ++n)
+    {
+        double* x = config(n);
+        for (unsigned j=0; j<cc; ++j)
+            packed[n*(cc+1)+j] = x[j];
+        packed[n*(cc+1)+cc] = weights[n];
+    }
+
+    // (only the state on the root process is written)
+    uint64_t state_count = state.size();
+    MPI_Bcast(&state_count, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+
+    MPI_Offset streams_at = sizeof(checkpoint_header);
+    MPI_Offset counts_at  = streams_at + MPI_Offset(params::np)*threads*sizeof(random_stream);
+    MPI_Offset sizes_at   = counts_at  + MPI_Offset(params::np)*sizeof(uint64_t);
+    MPI_Offset state_at   = sizes_at   + MPI_Offset(params::np)*sizeof(uint64_t);
+    MPI_Offset walkers_at = state_at   + MPI_Offset(state_count)*sizeof(double);
+
+    std::string tmp_filename = filename + ".tmp";
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, tmp_filename.c_str(),
+        MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+        throw "Could not open checkpoint file for writing!";
+    MPI_File_set_size(file, 0);
+
+    if (params::pid == 0)
+    {
+        checkpoint_header header;
+        for (unsigned i=0; i<8; ++i) header.magic[i] = checkpoint_magic[i];
+        header.iteration    = params::dmc_iteration;
+        header.walker_count = total;
+        header.coord_count   = cc;
+        header.process_count = params::np;
+        header.stream_count  = uint64_t(params::np) * threads;
+        header.seed         = params::seed;
+        header.trial_energy = params::trial_energy;
+        header.tau_nodes    = params::tau_nodes;
+        header.progress_size  = params::progress_file.size();
+        header.evolution_size = params::evolution_file.size();
+        header.state_count    = state_count;
+        header.stream_generation = params::stream_generation;
+        MPI_File_write_at(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+        MPI_File_write_at(file, counts_at, counts.data(), params::np, MPI_UINT64_T, MPI_STATUS_IGNORE);
+        MPI_File_write_at(file, sizes_at, output_sizes.data(), params::np, MPI_UINT64_T, MPI_STATUS_IGNORE);
+        MPI_File_write_at(file, state_at, state.data(), state_count, MPI_DOUBLE, MPI_STATUS_IGNORE);
+    }
+
+    MPI_File_write_at_all(file, streams_at + MPI_Offset(params::pid)*threads*sizeof(random_stream),
+        streams.data(), threads*sizeof(random_stream), MPI_BYTE, MPI_STATUS_IGNORE);
+    MPI_File_write_at_all(file, walkers_at + MPI_Offset(before)*(cc+1)*sizeof(double),
+        packed.data(), packed.size(), MPI_DOUBLE, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+
+    if (params::pid == 0)
+        std::rename(tmp_filename.c_str(), filename.c_str());
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+walker_collection* walker_collection :: read_checkpoint(std::string filename,
+                                                        std::vector<double>* state)
+{
+    mpi_call_site site("read_checkpoint");
+
+    // Create a collection of walkers from a checkpoint file (written by
+    // write_checkpoint, possibly with a different number of processes),
+    // restoring the iteration, trial energy and tau_nodes. The walkers
+    // are shared out evenly between processes, unless the number of
+    // processes is unchanged, in which case each process gets back the
+    // walkers it wrote. The random streams are restored if the number
+    // of processes, threads and the seed are unchanged, otherwise new
+    // streams are started which are guaranteed not to overlap any
+    // stream used earlier in the calculation. The state passed to write_checkpoint is
+    // returned in state (on all processes), if it is given.
+    unsigned cc      = walker::coord_count();
+    unsigned threads = params::threads;
+
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, filename.c_str(),
+        MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+        throw "Could not open checkpoint file for reading!";
+
+    checkpoint_header header;
+    MPI_File_read_at_all(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    for (unsigned i=0; i<8; ++i)
+        if (header.magic[i] != checkpoint_magic[i])
+            throw "Checkpoint file is not in the expected format!";
+    if (header.coord_count != cc)
+        throw "Checkpoint does not match the system being simulated!";
+
+    params::dmc_iteration     = header.iteration;
+    params::restart_iteration = header.iteration;
+    params::trial_energy      = header.trial_energy;
+    params::tau_nodes         = header.tau_nodes;
+
+    // Restore the random streams
+    MPI_Offset streams_at = sizeof(checkpoint_header);
+    MPI_Offset counts_at  = streams_at + MPI_Offset(header.stream_count)*sizeof(random_stream);
+    MPI_Offset sizes_at   = counts_at  + MPI_Offset(header.process_count)*sizeof(uint64_t);
+    MPI_Offset state_at   = sizes_at   + MPI_Offset(header.process_count)*sizeof(uint64_t);
+    MPI_Offset walkers_at = state_at   + MPI_Offset(header.state_count)*sizeof(double);
+    params::stream_generation = header.stream_generation;
+    if (header.stream_count == uint64_t(params::np) * threads && header.seed == params::seed)
+    {
+        std::vector<random_stream> streams(threads);
+        MPI_File_read_at_all(file, streams_at + MPI_Offset(params::pid)*threads*sizeof(random_stream),
+            streams.data(), threads*sizeof(random_stream), MPI_BYTE, MPI_STATUS_IGNORE);
+
+        #pragma omp parallel num_threads(threads)
+        rng = streams[thread_id()];
+    }
+    else
+    {
+        // Start new streams. The streams of a calculation have ids
+        // pid*threads + thread in the low 32 bits, and the number of
+        // times new streams have been started on restart in the high
+        // 32 bits, so the new streams cannot overlap any stream used
+        // earlier in the calculation (for fewer than 2^32 threads).
+        params::stream_generation = header.stream_generation + 1;
+        uint64_t generation = uint64_t(params::stream_generation) << 32;
+        #pragma omp parallel num_threads(threads)
+        seed_random(params::seed, generation + params::pid*threads + thread_id());
+    }
+
+    // Restore the state
+    std::vector<double> saved_state(header.state_count);
+    MPI_File_read_at_all(file, state_at, saved_state.data(), saved_state.size(),
+                         MPI_DOUBLE, MPI_STATUS_IGNORE);
+    if (state) state->swap(saved_state);
+
+    // Work out which walkers are mine
+    uint64_t first = header.walker_count * params::pid / params::np;
+    uint64_t last  = header.walker_count * (params::pid + 1) / params::np;
+    if (header.process_count == uint64_t(params::np))
+    {
+        std::vector<uint64_t> counts(params::np);
+        MPI_File_read_at_all(file, counts_at, counts.data(), params::np,
+                             MPI_UINT64_T, MPI_STATUS_IGNORE);
+        first = 0;
+        for (int pid=0; pid<params::pid; ++pid) first += counts[pid];
+        last = first + counts[params::pid];
+    }
+
+    // Read them
+    std::vector<double> packed((last - first)*(cc+1));
+    MPI_File_read_at_all(file, walkers_at + MPI_Offset(first)*(cc+1)*sizeof(double),
+        packed.data(), packed.size(), MPI_DOUBLE, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+
+    walker_collection* walkers = new walker_collection(nullptr);
+    for (unsigned n=0; n<last-first; ++n)
+        walkers->add(&packed[n*(cc+1)], packed[n*(cc+1)+cc]);
+    return walkers;
+}
+
+void walker_collection :: truncate_output(std::string filename)
+{
+    mpi_call_site site("truncate_output");
+
+    // Cut the progress, evolution and wavefunction files back to their
+    // sizes when the checkpoint was written, so that a restarted
+    // calculation carries on from the checkpointed iteration (rather
+    // than after output written since). Collective, called before
+    // any output of the restarted calculation.
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, filename.c_str(),
+        MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS)
+        throw "Could not open checkpoint file for reading!";
+
+    checkpoint_header header;
+    MPI_File_read_at_all(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    for (unsigned i=0; i<8; ++i)
+        if (header.magic[i] != checkpoint_magic[i])
+            throw "Checkpoint file is not in the expected format!";
+
+    MPI_Offset sizes_at = sizeof(checkpoint_header) +
+                          MPI_Offset(header.stream_count)*sizeof(random_stream) +
+                          MPI_Offset(header.process_count)*sizeof(uint64_t);
+    std::vector<uint64_t> sizes(header.process_count);
+    MPI_File_read_at_all(file, sizes_at, sizes.data(), sizes.size(),
+                         MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_File_close(&file);
+
+    // Processes that didn't exist when the checkpoint
+    // was written start their wavefunction files afresh
+    uint64_t pid = params::pid;
+    params::wavefunction_file.truncate(pid < sizes.size() ? sizes[pid] : 0);
+
+    if (params::pid != 0) return;
+    params::progress_file.truncate(header.progress_size);
+    params::evolution_file.truncate(header.evolution_size);
+
+    // Those of processes that no longer exist are cut back too
+    for (uint64_t p=params::np; p<sizes.size(); ++p)
+    {
+        output_file old("wavefunction_" + std::to_string(p));
+        old.truncate(sizes[p]);
+    }
 }
 
 walker_collection* walker_collection :: copy()
 {
     // Create an exact copy of this collection
     // of walkers
-    std::vector<walker*> copied_walkers;
-    for (unsigned n=0; n<walkers.size(); ++n)
-        copied_walkers.push_back(walkers[n]->copy());
-    return new walker_collection(copied_walkers);
+    return new walker_collection(this);
+}
+
+void walker_collection :: swap(walker_collection* other)
+{
+    // Swap the walkers in this collection with those in other
+    coords.swap(other->coords);
+    weights.swap(other->weights);
+    potentials.swap(other->potentials);
+    potential_dirty.swap(other->potential_dirty);
+}
+
+void walker_collection :: add(double* x, double weight)
+{
+    // Add a walker with configuration x and the given
+    // weight to the end of the collection
+    double_pool.reserve(coords, coords.size() + walker::coord_count());
+    double_pool.reserve(weights, size() + 1);
+    double_pool.reserve(potentials, size() + 1);
+    bool_pool.reserve(potential_dirty, size() + 1);
+
+    coords.insert(coords.end(), x, x + walker::coord_count());
+    weights.push_back(weight);
+    potentials.push_back(0);
+    potential_dirty.push_back(true);
+}
+
+double walker_collection :: potential(unsigned n)
+{
+    // Returns the potential of the n^th walker
+    // (re-evaluating it only if it has moved)
+    if (potential_dirty[n])
+    {
+        potentials[n]      = walker::potential(config(n));
+        potential_dirty[n] = false;
+    }
+    return potentials[n];
+}
+
+void walker_collection :: evaluate_potentials()
+{
+    // Evaluate the potentials of all walkers that need it, across
+    // threads. Afterwards, potential(n) only reads the cache, so
+    // can be called from several threads at once.
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (unsigned n=0; n<size(); ++n)
+        if (potential_dirty[n])
+            potentials[n] = walker::potential(config(n));
+    potential_dirty.assign(size(), false);
+}
+
+void walker_collection :: begin_propagation(walker_collection* walkers_last)
+{
+    // Set this collection up to contain the walkers in walkers_last,
+    // except for their configurations, which are set when the walkers
+    // are diffused from walkers_last (so must not be read before then).
+    unsigned n  = walkers_last->size();
+    index_valid = false;
+    double_pool.reserve(coords, walkers_last->coords.size());
+    double_pool.reserve(weights, n);
+    double_pool.reserve(potentials, n);
+    bool_pool.reserve(potential_dirty, n);
+
+    coords.resize(walkers_last->coords.size());
+    weights.assign(walkers_last->weights.begin(), walkers_last->weights.end());
+    potentials.resize(n);
+    potential_dirty.assign(n, true);
+}
+
+void walker_collection :: diffuse(walker_collection* walkers_last, double tau)
+{
+    // Set the walkers to those in walkers_last, diffused by tau,
+    // sampling the displacements for all walkers in batches
+    if (size() > 0)
+        diffuse_blocks(walkers_last->config(0), config(0), size(), tau);
+
+    // Particles have moved => potentials have changed
+    potential_dirty.assign(size(), true);
+}
+
+void walker_collection :: mpi_copy(unsigned n, int root_pid, walker* copy)
+{
+    mpi_call_site site("walker_collection::mpi_copy");
+
+    // Copy the n^th walker on the root process into
+    // copy, on all processes.
+    if (params::pid == root_pid)
+    {
+        double* x = config(n);
+        for (unsigned i=0; i<walker::coord_count(); ++i)
+            copy->coords[i] = x[i];
+        copy->weight = weights[n];
+    }
+
+    // Distribute the walker coordinates/weight across processes
+    MPI_Bcast(copy->coords, walker::coord_count(), MPI_DOUBLE, root_pid, MPI_COMM_WORLD);
+    MPI_Bcast(&copy->weight, 1, MPI_DOUBLE, root_pid, MPI_COMM_WORLD);
 }
 
 double walker_collection :: sum_mod_weight()
@@ -814,8 +1896,8 @@ double walker_collection :: sum_mod_weight()
     // Returns sum_i |w_i|
     // This is the effective population
     double sum = 0;
-    for (unsigned n=0; n<walkers.size(); ++n)
-        sum += fabs(walkers[n]->weight);
+    for (unsigned n=0; n<size(); ++n)
+        sum += fabs(weights[n]);
     return sum;
 }
 
@@ -823,9 +1905,9 @@ double walker_collection :: positive_weight()
 {
     // Returns the sum of all positive weights
     double positive_weight = 0;
-    for (unsigned n=0; n<walkers.size(); ++n)
-        if (walkers[n]->weight > 0)
-            positive_weight += walkers[n]->weight;
+    for (unsigned n=0; n<size(); ++n)
+        if (weights[n] > 0)
+            positive_weight += weights[n];
     return positive_weight;
 }
 
@@ -833,9 +1915,9 @@ double walker_collection :: negative_weight()
 {
     // Returns the modulus of the sum of all negative weights
     double negative_weight = 0;
-    for (unsigned n=0; n<walkers.size(); ++n)
-        if (walkers[n]->weight < 0)
-            negative_weight -= walkers[n]->weight;
+    for (unsigned n=0; n<size(); ++n)
+        if (weights[n] < 0)
+            negative_weight -= weights[n];
     return negative_weight;
 }
 
@@ -847,34 +1929,166 @@ double walker_collection :: average_potential()
     // weight w_i) and W = sum_i |w_i|
     double pot = 0;
     double weight = 0;
-    for (unsigned n=0; n<walkers.size(); ++n)
+    for (unsigned n=0; n<size(); ++n)
     {
-        pot    += walkers[n]->potential() * fabs(walkers[n]->weight);
-        weight += fabs(walkers[n]->weight);
+        pot    += potential(n) * fabs(weights[n]);
+        weight += fabs(weights[n]);
     }
     pot /= weight;
     return pot;
 }
 
+void walker_collection :: accumulate_densities(density_accumulator& densities)
+{
+    // Add the walkers on this process to the
+    // particle densities (summed across
+    // processes at the end of the calculation)
+    densities.accumulate(coords.data(), weights.data(), size());
+}
+
+// The header of a binary wavefunction file, which is followed by a
+// wavefunction_particle for each particle and then a block for each
+// iteration written. Each block contains the iteration and the number
+// of walkers (as uint64_t), the weight of every walker, then the
+// configuration of every walker (as [walker][particle][dimension]),
+// padded to a multiple of 8 bytes.
+struct wavefunction_header
+{
+    char     magic[8];
+    uint32_t dimensions;
+    uint32_t particle_count;
+    uint32_t value_size;
+    uint32_t reserved;
+};
+
+struct wavefunction_particle
+{
+    char     name[32];
+    double   mass;
+    double   charge;
+    int32_t  half_spins;
+    int32_t  reserved;
+};
+
+const char wavefunction_magic[8] = {'X', 'D', 'M', 'C', 'W', 'F', 'N', '1'};
+
+void walker_collection :: write_wavefunction()
+{
+    // Write the walkers on this process to the wavefunction file
+    // for this iteration, in the format params::wavefunction_format
+    output_file& file = params::wavefunction_file;
+    if (params::wavefunction_format == "text")
+    {
+        file << "# Iteration " << params::dmc_iteration << "\n";
+        for (unsigned n=0; n<size(); ++n)
+            walker::write_coords(file, weights[n], config(n));
+        return;
+    }
+
+    bool single = params::wavefunction_format == "binary_float";
+    unsigned value_size = single ? sizeof(float) : sizeof(double);
+
+    // Write the header at the start of the file (a restarted
+    // calculation continues on from an existing file)
+    if (file.size() == 0)
+    {
+        uint16_t endian_test = 1;
+        if (*(char*)&endian_test != 1)
+            throw "Binary wavefunction files can only be written on little-endian machines!";
+
+        wavefunction_header header;
+        for (unsigned i=0; i<8; ++i) header.magic[i] = wavefunction_magic[i];
+        header.dimensions     = params::dimensions;
+        header.particle_count = walker::particle_count();
+        header.value_size     = value_size;
+        header.reserved       = 0;
+        file.write(&header, sizeof(header));
+
+        for (particle* p : params::template_system)
+        {
+            wavefunction_particle info;
+            std::fill(info.name, info.name + sizeof(info.name), 0);
+            p->name.copy(info.name, sizeof(info.name) - 1);
+            info.mass       = p->mass;
+            info.charge     = p->charge;
+            info.half_spins = p->half_spins;
+            info.reserved   = 0;
+            file.write(&info, sizeof(info));
+        }
+    }
+
+    uint64_t block[2] = {uint64_t(params::dmc_iteration), size()};
+    file.write(block, sizeof(block));
+    if (single)
+    {
+        std::vector<float> values(weights.begin(), weights.end());
+        values.insert(values.end(), coords.begin(), coords.end());
+        file.write(values.data(), values.size()*sizeof(float));
+    }
+    else
+    {
+        file.write(weights.data(), weights.size()*sizeof(double));
+        file.write(coords.data(), coords.size()*sizeof(double));
+    }
+
+    const char padding[8] = {0};
+    size_t bytes = (weights.size() + coords.size()) * value_size;
+    file.write(padding, (8 - bytes % 8) % 8);
+}
+
 void walker_collection :: write_output(bool reverted)
 {
-    // Sum various things across processes
-    double population_red    = mpi_sum(double(walkers.size()));
-    double canc_weight_red   = mpi_sum(params::cancelled_weight);
-    int    reverted_red      = mpi_sum(int(reverted));
+    scoped_timer timer(PHASE_OUTPUT);
+    mpi_call_site site("write_output");
+
+    // The time spent in each phase on this process since the
+    // last output (the output itself counts towards the next)
+    double phase_times[PHASE_COUNT];
+    take_phase_times(phase_times);
+
+    // Sum/average various things across processes, all in one
+    // reduction, which completes whilst the wavefunction is written
+    mpi_sums sums;
+    unsigned i_population    = sums.add(double(size()));
+    unsigned i_canc_weight   = sums.add(params::cancelled_weight);
+    unsigned i_reverted      = sums.add(double(reverted));
+    unsigned i_pos_weight    = sums.add(positive_weight());
+    unsigned i_neg_weight    = sums.add(negative_weight());
+    unsigned i_allocations   = sums.add(double(walker::allocation_count));
+    unsigned i_triale        = sums.add(params::trial_energy);
+    unsigned i_tau_nodes     = sums.add(params::tau_nodes);
+    double   mod_weight      = sum_mod_weight();
+    unsigned i_mod_weight    = sums.add(mod_weight);
+    unsigned i_pot_weight    = sums.add(size() > 0 ? average_potential()*mod_weight : 0.0);
+    unsigned i_phase_times   = sums.add(phase_times[0]);
+    for (unsigned p=1; p<PHASE_COUNT; ++p) sums.add(phase_times[p]);
+    sums.begin_reduce();
+
+    // Write the wavefunction to file
+    if (params::write_wavefunction && params::dmc_iteration % params::wavefunction_interval == 0)
+        write_wavefunction();
+
+    sums.wait();
+    double population_red    = sums.sum(i_population);
+    double canc_weight_red   = sums.sum(i_canc_weight);
+    int    reverted_red      = int(sums.sum(i_reverted));
     double canc_weight_perc  = 100.0*canc_weight_red/double(population_red);
-    double pos_weight_red    = mpi_sum(positive_weight());
-    double neg_weight_red    = mpi_sum(negative_weight());
+    double pos_weight_red    = sums.sum(i_pos_weight);
+    double neg_weight_red    = sums.sum(i_neg_weight);
     double total_weight_red  = pos_weight_red - neg_weight_red;
     double av_weight_red     = total_weight_red / population_red;
-    double total_mod_weight  = pos_weight_red + neg_weight_red;
+    int    allocations_red   = int(sums.sum(i_allocations));
 
-    // Average various things across processes
-    double triale_red        = mpi_average(params::trial_energy);
-    double tau_nodes_red     = mpi_average(params::tau_nodes);
+    // The trial energy and nodal timestep are
+    // kept consistent across processes
+    double triale_red        = sums.average(i_triale);
+    double tau_nodes_red     = sums.average(i_tau_nodes);
+    params::trial_energy     = triale_red;
+    params::tau_nodes        = tau_nodes_red;
+    params::mixed_energy     = sums.sum(i_pot_weight) / sums.sum(i_mod_weight);
 
     // Calculate timing information
-    double time_per_iter     = params::dmc_time()/params::dmc_iteration;
+    double time_per_iter     = params::dmc_time()/(params::dmc_iteration - params::restart_iteration);
     double percent_complete  = double(100*params::dmc_iteration)/params::dmc_iterations;
     int secs_remain = int(time_per_iter * (params::dmc_iterations - params::dmc_iteration));
 
@@ -887,13 +2101,18 @@ void walker_collection :: write_output(bool reverted)
         << "s ("                       << time_per_iter                 << "s/iter)\n"
         << "    ETA                : " << seconds_to_human(secs_remain) << "\n"
         << "    Trial energy       : " << triale_red                    << " Hartree\n"
+        << "    Mixed energy       : " << params::mixed_energy          << " Hartree\n"
+        << "    Growth energy      : " << params::growth_energy         << " Hartree\n"
         << "    Population         : " << population_red                
         << " ("                        << population_red/params::np     << " per process) \n"
         << "    Cancelled weight   : " << canc_weight_red
         << " ("                        << canc_weight_perc              << "% of the total weight)\n"
         << "    Reverted on        : " << reverted_red 
         << "/"                         << params::np                    << " processes\n"
-        << "    Nodal timestep     : " << tau_nodes_red                 << " a.u\n";
+        << "    Nodal timestep     : " << tau_nodes_red                 << " a.u\n"
+        << "    Walker allocations : " << allocations_red               << " this iteration\n"
+        << "    Load imbalance     : " << params::load_imbalance
+        << " (max/mean population, "   << params::walkers_migrated      << " walkers migrated)\n";
 
     if (params::dmc_iteration == 1)
     {
@@ -906,7 +2125,10 @@ void walker_collection :: write_output(bool reverted)
                 << "Negative weight,"
                 << "Average weight,"
                 << "Cancelled weight,"
-                << "Tau_nodes\n";
+                << "Tau_nodes";
+        for (unsigned p=0; p<PHASE_COUNT; ++p)
+            params::evolution_file << "," << phase_name(timer_phase(p)) << " time";
+        params::evolution_file << "\n";
     }
 
     // Output evolution information to file
@@ -917,30 +2139,30 @@ void walker_collection :: write_output(bool reverted)
         << neg_weight_red                  << ","
         << av_weight_red                   << ","
         << canc_weight_red                 << ","
-        << tau_nodes_red                   << "\n";
+        << tau_nodes_red;
 
-    // Write the wavefunction to file
-    if (params::write_wavefunction)
-    {
-        params::wavefunction_file << "# Iteration " << params::dmc_iteration << "\n";
-        for (unsigned n=0; n<walkers.size(); ++n)
-            walkers[n]->write_coords(params::wavefunction_file);
-    }
+    // Output the time in each phase, averaged over processes
+    for (unsigned p=0; p<PHASE_COUNT; ++p)
+        params::evolution_file << "," << sums.average(i_phase_times + p);
+    params::evolution_file << "\n";
 
-    // Flush output files after every call
-    params::flush();
+    // Reset the allocation counter for the next iteration
+    // (output files are written to disk in the background,
+    // see output_file::flush_interval)
+    walker::allocation_count = 0;
 }
 
 bool walker_collection :: compare(walker_collection* other_walkers)
 {
+    mpi_call_site site("compare");
+
     // Compare two collections of walkers, returns false if 
     // they differ in any way (for testing purposes)
-    for (unsigned i=0; i<walkers.size(); ++i)
+    if (size() != other_walkers->size()) return false;
+    for (unsigned i=0; i<size(); ++i)
     {
-        walker* w1 = walkers[i];
-        walker* w2 = other_walkers->walkers[i];
-        if (!w1->compare(w2))
-            return false;
+        if (walker::sq_distance(config(i), other_walkers->config(i)) != 0) return false;
+        if (weights[i] != other_walkers->weights[i]) return false;
     }
 
     return true;
@@ -959,6 +2181,201 @@ TEST_CASE("Walker collection tests", "[walker_collection]")
         delete c_copy;
     }
 
+    SECTION("Load balancing")
+    {
+        // Create more walkers on the root process, after
+        // balancing populations should differ by at most one
+        unsigned target = params::target_population;
+        if (params::pid == 0) params::target_population *= 3;
+        walker_collection* uneven = new walker_collection();
+        params::target_population = target;
+
+        double total_before = mpi_sum(uneven->sum_mod_weight());
+        uneven->balance_load();
+
+        int size = uneven->size();
+        int smallest, largest;
+        MPI_Allreduce(&size, &smallest, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        MPI_Allreduce(&size, &largest,  1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+        REQUIRE(largest - smallest <= 1);
+        REQUIRE(mpi_sum(uneven->sum_mod_weight()) == total_before);
+        delete uneven;
+    }
+
+    SECTION("Propagation leaves walkers_last intact")
+    {
+        // Propagating into another collection should not
+        // modify the source collection (so that iterations
+        // can be reverted)
+        walker_collection* c_copy = c->copy();
+        walker_collection* c_next = new walker_collection(nullptr);
+        c_next->propagate(c);
+        REQUIRE(c->compare(c_copy));
+        delete c_copy;
+        delete c_next;
+    }
+
     // Free memory
     delete c;
 }
+
+TEST_CASE("Checkpoint tests", "[walker_collection]")
+{
+    // Two fermions in a harmonic well, in a temporary
+    // system, restoring the parameters after
+    unsigned dimensions   = params::dimensions;
+    unsigned population   = params::target_population;
+    unsigned long seed    = params::seed;
+    double   trial_energy = params::trial_energy;
+    std::string input = "dimensions 1\n"
+                        "harmonic_well 1.0\n"
+                        "particle f 1 0 1 0\n"
+                        "particle f 1 0 1 0\n";
+    std::istringstream input_stream(input);
+    params::read_input(input_stream);
+    walker_collection::select_kernels();
+    REQUIRE(walker::coord_count() == 2);
+
+    // A different population on each process
+    params::target_population = 8 + 3*params::pid;
+    walker_collection* c = new walker_collection();
+    params::target_population = population;
+
+    // Write a checkpoint, then read it back (changing
+    // the seed in between, if new_seed is set)
+    auto round_trip = [](walker_collection* w, std::vector<double>& state_read,
+                         bool new_seed)
+    {
+        std::vector<double> state;
+        if (params::pid == 0) state = {1.0, -2.5, 3.0};
+        w->write_checkpoint("test_checkpoint", state);
+        if (new_seed) params::seed += 1;
+        walker_collection* w_read = walker_collection::read_checkpoint("test_checkpoint", &state_read);
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (params::pid == 0) std::remove("test_checkpoint");
+        return w_read;
+    };
+
+    SECTION("Walkers, state and streams are restored")
+    {
+        // With the same processes, each gets back it's own walkers
+        // and continues it's random streams
+        random_stream before = rng;
+        std::vector<double> state_read;
+        walker_collection* c_read = round_trip(c, state_read, false);
+        REQUIRE(c->compare(c_read));
+        REQUIRE(state_read == std::vector<double>({1.0, -2.5, 3.0}));
+        REQUIRE(params::stream_generation == 0);
+        for (unsigned i=0; i<4; ++i)
+            REQUIRE(rng.ctr[i] == before.ctr[i]);
+        delete c_read;
+
+        // Likewise after the walkers have been redistributed
+        c->balance_load();
+        c_read = round_trip(c, state_read, false);
+        REQUIRE(c->compare(c_read));
+        delete c_read;
+    }
+
+    SECTION("New streams do not overlap")
+    {
+        // With a different seed, the walkers are restored but new
+        // streams are started, in a new range of stream ids on
+        // every restart
+        for (unsigned restart=1; restart<=2; ++restart)
+        {
+            std::vector<double> state_read;
+            walker_collection* c_read = round_trip(c, state_read, true);
+            REQUIRE(c->compare(c_read));
+            REQUIRE(params::stream_generation == restart);
+            REQUIRE(rng.ctr[0] == 0);
+            REQUIRE(rng.ctr[3] == restart);
+            delete c_read;
+        }
+    }
+
+    delete c;
+    std::istringstream empty("");
+    params::read_input(empty);
+    params::dimensions        = dimensions;
+    params::target_population = population;
+    params::seed              = seed;
+    params::trial_energy      = trial_energy;
+    params::dmc_iteration     = 0;
+    params::restart_iteration = 0;
+    params::stream_generation = 0;
+    walker_collection::select_kernels();
+    #pragma omp parallel num_threads(params::threads)
+    seed_random(params::seed, params::pid*params::threads + thread_id());
+}
+
+TEST_CASE("Diffused wavefunction tests", "[walker_collection]")
+{
+    // A temporary system of two distinguishable particles, with
+    // enough walkers that the many small contributions neglected
+    // by the psi_D cutoff could add up
+    unsigned population = params::target_population;
+    double tolerance    = params::psi_d_tolerance;
+    walker::free_pool();
+    for (unsigned i=0; i<2; ++i)
+    {
+        particle* p   = new particle();
+        p->name       = i == 0 ? "a" : "b";
+        p->mass       = 1.0;
+        p->charge     = 0.0;
+        p->half_spins = 0;
+        params::template_system.push_back(p);
+    }
+    params::target_population = 20000 * params::np;
+    walker_collection* c = new walker_collection();
+    double tau = 0.5;
+
+    SECTION("The psi_D tolerance bounds the total error")
+    {
+        for (double offset : {0.0, 0.5, 1.5})
+        {
+            std::vector<double> x(walker::coord_count(), offset);
+
+            params::psi_d_tolerance = 0;
+            c->build_index();
+            double exact = c->diffused_wavefunction(x.data(), tau, -1);
+
+            params::psi_d_tolerance = 1e-3;
+            c->build_index();
+            double cut = c->diffused_wavefunction(x.data(), tau, -1);
+
+            REQUIRE(fabs(exact - cut) <= params::psi_d_tolerance * fabs(exact));
+        }
+    }
+
+    SECTION("Batched evaluation matches evaluation one query at a time")
+    {
+        // Evaluated at the walkers themselves, with their own
+        // contributions reduced, to within rounding of the distances
+        double self_strength = params::self_gf_strength;
+        params::self_gf_strength = 0.25;
+        params::target_population = 500 * params::np;
+        walker_collection* small = new walker_collection();
+        params::psi_d_tolerance = 0;
+        small->build_index();
+
+        std::vector<double> psi;
+        small->diffused_wavefunction_batch(small, tau, psi);
+        for (unsigned q=0; q<small->size(); ++q)
+        {
+            double single = small->diffused_wavefunction(small->config(q), tau, int(q));
+            REQUIRE(fabs(psi[2*q] - psi[2*q+1] - single) <= 1e-9 * fabs(single));
+        }
+
+        delete small;
+        params::self_gf_strength = self_strength;
+    }
+
+    // Restore the original (empty) system
+    delete c;
+    walker::free_pool();
+    for (particle* p : params::template_system) delete p;
+    params::template_system.clear();
+    params::target_population = population;
+    params::psi_d_tolerance   = tolerance;
+}
@@ -21,33 +21,76 @@
 #define __WALKER_COLLECTION__
 
 #include "walker.h"
+#include "kd_tree.h"
+#include "gauss_transform.h"
+#include "density.h"
 
-// A collection of walkers
+// A collection of walkers, stored as a structure of arrays
 class walker_collection
 {
 public:
     walker_collection();
+    walker_collection(walker_collection* to_copy);
     ~walker_collection();
     walker_collection* copy();
 
     bool propagate(walker_collection* walkers_last);
     bool compare(walker_collection* other_walkers);
     void write_output(bool reverted);
+    void write_wavefunction();
     void estimate_tau_nodes();
-
+    void balance_load();
+    void accumulate_densities(density_accumulator& densities);
+
+    // Checkpointing of the full DMC state, along with any other state
+    // (e.g accumulated estimates) given on the root process
+    void write_checkpoint(std::string filename,
+                          const std::vector<double>& state = std::vector<double>());
+    static walker_collection* read_checkpoint(std::string filename,
+                                              std::vector<double>* state = nullptr);
+    static void truncate_output(std::string filename);
+
+    unsigned size() { return weights.size(); }
+    double* config(unsigned n) { return &coords[n*walker::coord_count()]; }
     double positive_weight();
     double negative_weight();
     double average_potential();
     double sum_mod_weight();
 
-private:
-    walker_collection(std::vector<walker*> walkers_in) : walkers(walkers_in) {}
+    // Select the kernels specialised to the number of dimensions
+    static void select_kernels();
+
+    // Evaluate the diffused wavefunction of these walkers (build_index
+    // must be called first, and again whenever the walkers change)
+    void build_index();
+    double diffused_wavefunction(double* x, double tau, int self_index);
+    void diffused_wavefunction_batch(walker_collection* queries, double tau, std::vector<double>& psi);
 
-    double diffused_wavefunction(walker* w, double tau, int self_index);
-    double* diffused_wavefunction_signed(walker* w, double tau, int self_index);
-    double* exchange_diffused_wfn_signed(walker* w, double tau, int self_index);
+    // The number of evaluations of the diffused wavefunction (at one
+    // configuration, from one collection) made on this process
+    static unsigned long long psi_d_evaluations;
 
-    double distance_to_nearest_opposite(walker* w);
+private:
+
+    bool indexed() { return params::psi_d_tolerance > 0 && index_valid; }
+    double psi_d_cutoff(double* x, double tau);
+    gauss_transform* transform(double tau);
+    bool transformed_wavefunction(double* x, double tau, int self_index, double* psi);
+    void diffused_wavefunction_signed(double* x, double weight, double* psi, double tau, int self_index);
+    void exchange_diffused_wfn_signed(double* x, double weight, double* psi, double tau, int self_index);
+    double exchange_diffused_wfn(double* x, double weight, double tau, int self_index);
+
+    // The above, specialised to D dimensions (D = 0 => generic)
+    static const unsigned gf_block = 256;
+    template<unsigned D> void diffusive_greens_functions(double* x, double tau, unsigned n0, unsigned nb, double* gf);
+    template<unsigned D> double diffused_wavefunction(double* x, double tau, int self_index);
+    template<unsigned D> void diffused_wavefunction_signed(double* x, double weight, double* psi, double tau, int self_index);
+    template<unsigned D> double distance_to_nearest_opposite(double* x, double weight);
+    static double (walker_collection::*psi_d_kernel)(double*, double, int);
+    static void (walker_collection::*psi_d_signed_kernel)(double*, double, double*, double, int);
+    static double (walker_collection::*nearest_opposite_kernel)(double*, double);
+
+    double distance_to_nearest_opposite(double* x, double weight);
     double tau_nodes_min_sep();
     double tau_nodes_min_sep_mpi();
 
@@ -55,7 +98,7 @@ private:
     void branch();
 
     void make_diffusive_moves(walker_collection* walkers_last);
-    void diffuse_exact_1d();
+    void diffuse_exact_1d(walker_collection* walkers_last);
     void diffuse_max_seperation(walker_collection* walkers_last);
     void diffuse_max_seperation_mpi(walker_collection* walkers_last);
     void diffuse_stochastic_nodes(walker_collection* walkers_last);
@@ -68,8 +111,37 @@ private:
     void renormalize_growth();
     void renormalize_potential();
 
-    std::vector<walker*> walkers;
+    // Access to the n^th walker
+    double potential(unsigned n);
+    void evaluate_potentials();
+    void begin_propagation(walker_collection* walkers_last);
+    void diffuse(walker_collection* walkers_last, double tau);
+    void add(double* x, double weight);
+    void swap(walker_collection* other);
+    void mpi_copy(unsigned n, int root_pid, walker* copy);
+
+    // The walker configurations, stored contiguously
+    // as [walker][particle][dimension], such that sums
+    // over walkers stream linearly through memory.
+    std::vector<double> coords;
+
+    // The walker weights, and a cache of the
+    // potential energy of each walker
+    std::vector<double> weights;
+    std::vector<double> potentials;
+    std::vector<bool>   potential_dirty;
+
+    // Spatial index over the walker configurations, used to
+    // evaluate the diffused wavefunction to within
+    // params::psi_d_tolerance, and fast gauss transforms of
+    // the walkers (one for each value of tau used). These are
+    // valid whilst this collection is being propagated from
+    // (see build_index).
+    kd_tree index;
+    double max_abs_weight = 0;
+    std::vector<gauss_transform> transforms;
+    unsigned transforms_used = 0;
+    bool index_valid = false;
 };
 
 #endif
-